@@ -233,6 +233,25 @@ static void hud_print_status(int auto_mode, float zoff, int speed_level, int dis
 
 // Main
 
+// Key presses come from the event queue, one can be put back when it
+// cut the wait for the next frame short
+static unsigned int pending_key = 0;
+
+static unsigned int next_key(unsigned int timeout) {
+    aso_event_t ev;
+
+    if (pending_key) {
+        unsigned int k = pending_key;
+        pending_key = 0;
+        return k;
+    }
+
+    if (sys_wait_event(1u << ASO_EV_KEY_DOWN, timeout, &ev) == ASO_EV_KEY_DOWN)
+        return ev.data;
+
+    return 0;
+}
+
 void main(void) {
     unsigned int info = sys_gfx_info();
 
@@ -292,6 +311,7 @@ void main(void) {
     hud_print_status(auto_mode, zoff, speed_level, disco_on);
 
     unsigned int last_cursor_park = sys_getticks() + 6;
+    const aso_key_state_t* keys = sys_kbd_state();
 
     const unsigned int frame_ticks = 2;
     unsigned int next_frame = sys_getticks();
@@ -299,45 +319,39 @@ void main(void) {
     for (;;) {
         // Input
         for (;;) {
-            unsigned int ch = sys_trygetchar();
+            unsigned int ch = next_key(0);
             if (!ch)
                 break;
 
             char c = (char)ch;
 
+            if ((unsigned char)c == KEY_RIGHT) {
+                set_shape(shape_index + 1);
+                hud_print_status(auto_mode, zoff, speed_level, disco_on);
+                continue;
+            }
+
+            if ((unsigned char)c == KEY_LEFT) {
+                set_shape(shape_index - 1);
+                hud_print_status(auto_mode, zoff, speed_level, disco_on);
+                continue;
+            }
+
+            if ((unsigned char)c == KEY_UP) {  // faster
+                if (speed_level < 2)
+                    speed_level++;
+                hud_print_status(auto_mode, zoff, speed_level, disco_on);
+                continue;
+            }
+
+            if ((unsigned char)c == KEY_DOWN) {  // slower
+                if (speed_level > -2)
+                    speed_level--;
+                hud_print_status(auto_mode, zoff, speed_level, disco_on);
+                continue;
+            }
+
             if (c == 27) {
-                // Try to parse ESC [ A/B/C/D
-                unsigned int c1 = sys_trygetchar();
-                if (c1 == '[') {
-                    unsigned int c2 = sys_trygetchar();
-                    if (c2 == 'C') {  // right
-                        set_shape(shape_index + 1);
-                        hud_print_status(auto_mode, zoff, speed_level,
-                                         disco_on);
-                        continue;
-                    }
-                    if (c2 == 'D') {  // left
-                        set_shape(shape_index - 1);
-                        hud_print_status(auto_mode, zoff, speed_level,
-                                         disco_on);
-                        continue;
-                    }
-                    if (c2 == 'A') {  // up -> faster
-                        if (speed_level < 2)
-                            speed_level++;
-                        hud_print_status(auto_mode, zoff, speed_level,
-                                         disco_on);
-                        continue;
-                    }
-                    if (c2 == 'B') {  // down -> slower
-                        if (speed_level > -2)
-                            speed_level--;
-                        hud_print_status(auto_mode, zoff, speed_level,
-                                         disco_on);
-                        continue;
-                    }
-                }
-                // Lone ESC = quit
                 sys_write("\nBye\n");
                 sys_exit();
             }
@@ -400,68 +414,66 @@ void main(void) {
                 hud_print_status(auto_mode, zoff, speed_level, disco_on);
                 continue;
             }
+        }
 
-            // Manual rotation on lower-case wasd
-            if (c == 'a') {
+        unsigned int now = sys_getticks();
+        if ((int)(now - next_frame) < 0) {
+            pending_key = next_key(next_frame - now);
+            continue;
+        }
+        next_frame += frame_ticks;
+
+        // Manual rotation on lower-case wasd, read from the key bitmap so a
+        // held key turns smoothly every frame instead of at typematic rate
+        if (!(keys->modifiers & (KMOD_SHIFT | KMOD_CAPS | KMOD_CTRL))) {
+            int manual = 0;
+
+            if (is_key_down(SC_A)) {
                 float nc = cay * MC - say * MS;
                 float ns = say * MC + cay * MS;
                 float inv = finvsqrt(nc * nc + ns * ns);
 
                 cay = nc * inv;
                 say = ns * inv;
-                auto_mode = 0;
-
-                hud_print_status(auto_mode, zoff, speed_level, disco_on);
-                continue;
+                manual = 1;
             }
 
-            if (c == 'd') {
+            if (is_key_down(SC_D)) {
                 float nc = cay * MC + say * MS;
                 float ns = say * MC - cay * MS;
                 float inv = finvsqrt(nc * nc + ns * ns);
 
                 cay = nc * inv;
                 say = ns * inv;
-                auto_mode = 0;
-
-                hud_print_status(auto_mode, zoff, speed_level, disco_on);
-                continue;
+                manual = 1;
             }
 
-            if (c == 'w') {
+            if (is_key_down(SC_W)) {
                 float nc = cax * MC - sax * MS;
                 float ns = sax * MC + cax * MS;
                 float inv = finvsqrt(nc * nc + ns * ns);
 
                 cax = nc * inv;
                 sax = ns * inv;
-                auto_mode = 0;
-
-                hud_print_status(auto_mode, zoff, speed_level, disco_on);
-                continue;
+                manual = 1;
             }
 
-            if (c == 's') {
+            if (is_key_down(SC_S)) {
                 float nc = cax * MC + sax * MS;
                 float ns = sax * MC - cax * MS;
                 float inv = finvsqrt(nc * nc + ns * ns);
 
                 cax = nc * inv;
                 sax = ns * inv;
-                auto_mode = 0;
+                manual = 1;
+            }
 
+            if (manual && auto_mode) {
+                auto_mode = 0;
                 hud_print_status(auto_mode, zoff, speed_level, disco_on);
-                continue;
             }
         }
 
-        unsigned int now = sys_getticks();
-        if ((int)(now - next_frame) < 0) {
-            asm volatile("hlt");
-            continue;
-        }
-        next_frame += frame_ticks;
-
         // Auto rotation with speed levels
         // level -2: rotate every 4th frame
         // level -1: rotate every 2nd frame
@@ -5,6 +5,36 @@
 #define KEY_RIGHT  0x91
 #define KEY_UP     0x92
 #define KEY_DOWN   0x93
+#define KEY_HOME   0x94
+#define KEY_END    0x95
+#define KEY_PGUP   0x96
+#define KEY_PGDN   0x97
+#define KEY_INSERT 0x98
+#define KEY_DELETE 0x99
+
+// Modifier bits
+#define KMOD_SHIFT 0x01
+#define KMOD_CTRL  0x02
+#define KMOD_ALT   0x04
+#define KMOD_CAPS  0x08
+
+// Key-state indexes (set-1 make codes), E0 keys live in the upper half
+#define SC_E0(code) (0x80 | (code))
+#define SC_ESC    0x01
+#define SC_ENTER  0x1C
+#define SC_LCTRL  0x1D
+#define SC_LSHIFT 0x2A
+#define SC_RSHIFT 0x36
+#define SC_LALT   0x38
+#define SC_SPACE  0x39
+#define SC_W      0x11
+#define SC_A      0x1E
+#define SC_S      0x1F
+#define SC_D      0x20
+#define SC_UP     SC_E0(0x48)
+#define SC_LEFT   SC_E0(0x4B)
+#define SC_RIGHT  SC_E0(0x4D)
+#define SC_DOWN   SC_E0(0x50)
 
 enum {
     SYSCALL_WRITE = 1,
@@ -30,6 +60,16 @@ enum {
     SYSCALL_GFX_CLEAR = 21,
     SYSCALL_GFX_PUTPX = 22,
     SYSCALL_GFX_BLIT = 23,
+    SYSCALL_SUBMIT = 24,
+    SYSCALL_STATS = 25,
+    SYSCALL_PROF = 26,
+    SYSCALL_WAIT_EVENT = 27,
+    SYSCALL_KBD_READ = 28,
+    SYSCALL_KBD_STATE = 29,
+    SYSCALL_GFX_BLIT_RECT = 30,
+    SYSCALL_GFX_BLIT_NATIVE = 31,
+    SYSCALL_GFX_DRAW = 32,
+    SYSCALL_GFX_CMDS = 33,
 };
 typedef struct { 
     char ch; 
@@ -41,6 +81,250 @@ typedef struct {
     unsigned int buttons; // bit0=L, bit1=R, bit2=M
 } mouse_info_t;
 
+// Queued pointer events (sys_mouse_events), same layout as mouse_event_t in the kernel
+enum {
+    ASO_MOUSE_MOVE = 1,
+    ASO_MOUSE_BUTTON = 2,
+    ASO_MOUSE_WHEEL = 3,
+};
+
+typedef struct {
+    unsigned short type;
+    unsigned short buttons;
+    short x, y;     // Position after the event
+    short dx, dy;   // Motion folded into this event
+    short wheel;    // Notches, negative = away from the user
+    unsigned short reserved;
+    unsigned long long tsc;
+} aso_mouse_event_t;
+
+// SYSCALL_STATS sub-commands
+enum {
+    ASO_STATS_GET = 0,
+    ASO_STATS_RESET = 1,
+    ASO_STATS_TRACE_ON = 2,
+    ASO_STATS_TRACE_OFF = 3,
+    ASO_STATS_TRACE_READ = 4,
+    ASO_STATS_IRQ = 5, // IRQ 0-15 followed by ASO_SOFTIRQS softirqs
+};
+
+#define ASO_SOFTIRQS 8
+
+#define ASO_STATS_MAX 64
+#define ASO_TRACE_ENTRIES 256
+
+typedef struct {
+    unsigned int calls;
+    unsigned int reserved;
+    unsigned long long total_cycles;
+    unsigned long long max_cycles;
+} aso_sysstat_t;
+
+typedef struct {
+    unsigned long long tsc;
+    unsigned int num;
+    unsigned int ebx, ecx, edx;
+    unsigned int res;
+    unsigned int cycles;
+} aso_systrace_t;
+
+// SYSCALL_PROF sub-commands
+enum {
+    ASO_PROF_START = 0,
+    ASO_PROF_STOP = 1,
+    ASO_PROF_RESET = 2,
+    ASO_PROF_DUMP = 3,
+};
+
+#define ASO_PROF_SLOTS 2048
+#define ASO_PROF_CALLGRAPH 0x01
+
+typedef struct {
+    unsigned int eip;
+    unsigned int self;
+    unsigned int total;
+    char app[16];
+} aso_prof_sample_t;
+
+// Raw key events (SYSCALL_KBD_READ), same layout as kbd_event_t in the kernel
+typedef struct {
+    unsigned short scancode; // 0xE0xx for extended keys
+    unsigned char keycode;   // Character or KEY_*, 0 if none
+    unsigned char pressed;
+    unsigned char modifiers; // KMOD_*
+    unsigned char reserved[3];
+    unsigned long long tsc;
+} aso_key_event_t;
+
+// Live keyboard state (SYSCALL_KBD_STATE), updated by the kernel on every key
+typedef struct {
+    volatile unsigned int keys[8]; // Bit per SC_* index
+    volatile unsigned int modifiers;
+} aso_key_state_t;
+
+// Framebuffer pixel layout (sys_gfx_info_ex)
+enum {
+    ASO_FMT_XRGB = 0,  // Same as RGB(), nothing to convert
+    ASO_FMT_XBGR = 1,  // Red and blue swapped
+    ASO_FMT_OTHER = 2,
+};
+
+typedef struct {
+    unsigned int fb;
+    unsigned short w, h;
+    unsigned short pitch;
+    unsigned char bpp;
+    unsigned char format; // ASO_FMT_*
+    unsigned char r_size, r_pos;
+    unsigned char g_size, g_pos;
+    unsigned char b_size, b_pos;
+} aso_gfx_info_t;
+
+// RGB() in framebuffer order, for buffers handed to sys_gfx_blit_native
+#define ASO_RGB_NATIVE(gi, r, g, b) \
+    (((((unsigned)(r) & 0xFF) >> (8 - (gi)->r_size)) << (gi)->r_pos) | \
+     ((((unsigned)(g) & 0xFF) >> (8 - (gi)->g_size)) << (gi)->g_pos) | \
+     ((((unsigned)(b) & 0xFF) >> (8 - (gi)->b_size)) << (gi)->b_pos))
+
+// One window for sys_gfx_blit_rects: (sx, sy) of an image with 'stride'
+// pixels per row goes to (dx, dy) on screen
+typedef struct {
+    unsigned int stride;
+    short sx, sy;
+    short dx, dy;
+    short w, h;
+} aso_blit_rect_t;
+
+// Kernel-drawn primitives (sys_gfx_draw), all clipped to the screen
+enum {
+    ASO_OP_FILL = 0,   // w*h of color at (x, y)
+    ASO_OP_HLINE = 1,
+    ASO_OP_VLINE = 2,
+    ASO_OP_LINE = 3,   // (x, y) to (sx, sy)
+    ASO_OP_COPY = 4,   // Screen w*h at (sx, sy) moved to (x, y)
+    ASO_OP_SPRITE = 5, // Window (sx, sy) of src, pixels equal to color skipped
+    ASO_OP_BLEND = 6,  // Window (sx, sy) of 0xAARRGGBB src blended over the screen
+};
+
+typedef struct {
+    unsigned short op; // ASO_OP_*
+    unsigned short reserved;
+    short x, y;
+    short w, h;
+    short sx, sy;
+    unsigned int color; // RGB()
+    unsigned int stride; // src pixels per row
+    const unsigned int* src;
+} aso_draw_t;
+
+// Draw-command buffer for sys_gfx_cmds: commands packed back to back, each
+// starting with aso_cmd_t and a multiple of 4 bytes long. Build it with the
+// aso_cmd_* helpers below.
+enum {
+    ASO_CMD_FILL = 1,      // aso_cmd_rect_t
+    ASO_CMD_LINE = 2,      // aso_cmd_line_t
+    ASO_CMD_TEXT = 3,      // aso_cmd_text_t + characters
+    ASO_CMD_SPRITE = 4,    // aso_cmd_sprite_t
+    ASO_CMD_CLIP_PUSH = 5, // aso_cmd_rect_t, nests up to ASO_CLIP_DEPTH deep
+    ASO_CMD_CLIP_POP = 6,  // aso_cmd_t
+};
+
+#define ASO_CLIP_DEPTH 8
+#define ASO_TEXT_FG_ONLY 0x0001
+#define ASO_NO_KEY 0xFFFFFFFFu
+
+typedef struct {
+    unsigned short op; // ASO_CMD_*
+    unsigned short size;
+} aso_cmd_t;
+
+typedef struct {
+    aso_cmd_t hdr;
+    short x, y, w, h;
+    unsigned int color;
+} aso_cmd_rect_t;
+
+typedef struct {
+    aso_cmd_t hdr;
+    short x0, y0, x1, y1;
+    unsigned int color;
+} aso_cmd_line_t;
+
+typedef struct {
+    aso_cmd_t hdr;
+    short x, y;
+    unsigned int fg, bg;
+    unsigned short len;
+    unsigned short flags; // ASO_TEXT_*
+} aso_cmd_text_t;
+
+typedef struct {
+    aso_cmd_t hdr;
+    short x, y, w, h;
+    short sx, sy;
+    unsigned int stride;
+    unsigned int key; // RGB() left out, or ASO_NO_KEY
+    const unsigned int* src;
+} aso_cmd_sprite_t;
+
+typedef struct {
+    unsigned char* buf; // 4-byte aligned
+    unsigned int cap, used;
+    unsigned int dropped; // Commands that didn't fit
+} aso_cmdbuf_t;
+
+// Events (SYSCALL_WAIT_EVENT), mask = bit per type
+enum {
+    ASO_EV_NONE = 0,
+    ASO_EV_KEY_DOWN = 1,     // code = scancode (0xE0xx extended), data = character or KEY_*
+    ASO_EV_KEY_UP = 2,
+    ASO_EV_MOUSE_MOVE = 3,   // x, y = position, data = buttons
+    ASO_EV_MOUSE_BUTTON = 4, // code = buttons that changed
+    ASO_EV_TIMER = 5,        // Timeout expired
+    ASO_EV_IO = 6,           // Submission ring posted completions, data = count
+    ASO_EV_MOUSE_WHEEL = 7,  // data = signed notches
+};
+
+#define ASO_EVM_KEY   ((1u << ASO_EV_KEY_DOWN) | (1u << ASO_EV_KEY_UP))
+#define ASO_EVM_MOUSE ((1u << ASO_EV_MOUSE_MOVE) | (1u << ASO_EV_MOUSE_BUTTON) | (1u << ASO_EV_MOUSE_WHEEL))
+#define ASO_EVM_TIMER (1u << ASO_EV_TIMER)
+#define ASO_EVM_IO    (1u << ASO_EV_IO)
+
+#define ASO_WAIT_FOREVER 0xFFFFFFFFu
+
+typedef struct {
+    unsigned short type;
+    unsigned short code;
+    short x, y;
+    unsigned int data;
+    unsigned int ticks;
+} aso_event_t;
+
+// Submission ring (SYSCALL_SUBMIT), same layout as sys_ring_t in the kernel
+#define ASO_RING_ENTRIES 256
+#define ASO_RING_MASK (ASO_RING_ENTRIES - 1)
+
+#define ASO_SQE_NOCQE 0x0001 // Only post a completion if the op fails
+
+typedef struct {
+    unsigned short op;
+    unsigned short flags;
+    unsigned int ebx, ecx, edx;
+    unsigned int user_data;
+} aso_sqe_t;
+
+typedef struct {
+    unsigned int user_data;
+    unsigned int res;
+} aso_cqe_t;
+
+typedef struct {
+    volatile unsigned int sq_head, sq_tail;
+    volatile unsigned int cq_head, cq_tail;
+    aso_sqe_t sq[ASO_RING_ENTRIES];
+    aso_cqe_t cq[ASO_RING_ENTRIES];
+} aso_ring_t;
+
 static inline unsigned int sys_getticks(void){
     unsigned int t;
 
@@ -189,7 +473,19 @@ static inline int sys_mouse_get(mouse_info_t* out) {
 
     asm volatile("int $0x80" 
                 : "=a"(ret) 
-                : "a"(SYSCALL_MOUSE_GET), "b"(out) 
+                : "a"(SYSCALL_MOUSE_GET), "b"(out), "c"(0) 
+                : "memory", "cc");
+
+    return ret;
+}
+
+// Drains up to max queued events, 'state' (optional) gets the current position
+static inline int sys_mouse_events(mouse_info_t* state, aso_mouse_event_t* out, int max) {
+    int ret;
+
+    asm volatile("int $0x80"
+                : "=a"(ret)
+                : "a"(SYSCALL_MOUSE_GET), "b"(state), "c"(out), "d"(max)
                 : "memory", "cc");
 
     return ret;
@@ -218,7 +514,19 @@ static inline unsigned int sys_gfx_info(void){
 
     asm volatile("int $0x80" 
                 : "=a"(packed) 
-                : "a"(SYSCALL_GFX_INFO) 
+                : "a"(SYSCALL_GFX_INFO), "b"(0) 
+                : "memory","cc");
+
+    return packed;
+}
+
+// Same return value, also fills in the framebuffer's pixel format
+static inline unsigned int sys_gfx_info_ex(aso_gfx_info_t* gi){
+    unsigned int packed;
+
+    asm volatile("int $0x80" 
+                : "=a"(packed) 
+                : "a"(SYSCALL_GFX_INFO), "b"(gi) 
                 : "memory","cc");
 
     return packed;
@@ -256,3 +564,363 @@ static inline int sys_gfx_blit(const unsigned int* rgb32_fullscreen){
 
     return ret;
 }
+
+// Pushes only the listed windows of rgb32 to the screen, clipped.
+// Returns the number of pixels written.
+static inline int sys_gfx_blit_rects(const unsigned int* rgb32, const aso_blit_rect_t* rects, int count){
+    int ret;
+
+    asm volatile("int $0x80"
+                : "=a"(ret)
+                : "a"(SYSCALL_GFX_BLIT_RECT), "b"(rgb32), "c"(rects), "d"(count)
+                : "memory","cc");
+
+    return ret;
+}
+
+static inline int sys_gfx_blit_rect(const unsigned int* rgb32, int stride, int sx, int sy,
+                                    int dx, int dy, int w, int h){
+    aso_blit_rect_t r = { (unsigned int)stride, (short)sx, (short)sy, (short)dx, (short)dy, (short)w, (short)h };
+
+    return sys_gfx_blit_rects(rgb32, &r, 1);
+}
+
+// sys_gfx_blit_rects for pixels already in framebuffer order: a plain copy
+static inline int sys_gfx_blit_native(const unsigned int* px, const aso_blit_rect_t* rects, int count){
+    int ret;
+
+    asm volatile("int $0x80"
+                : "=a"(ret)
+                : "a"(SYSCALL_GFX_BLIT_NATIVE), "b"(px), "c"(rects), "d"(count)
+                : "memory","cc");
+
+    return ret;
+}
+
+// Returns 0, or negative for a bad op
+static inline int sys_gfx_draw(const aso_draw_t* op){
+    int ret;
+
+    asm volatile("int $0x80"
+                : "=a"(ret)
+                : "a"(SYSCALL_GFX_DRAW), "b"(op)
+                : "memory","cc");
+
+    return ret;
+}
+
+static inline int sys_gfx_fill(int x, int y, int w, int h, unsigned int rgb){
+    aso_draw_t op = { ASO_OP_FILL, 0, (short)x, (short)y, (short)w, (short)h, 0, 0, rgb, 0, 0 };
+
+    return sys_gfx_draw(&op);
+}
+
+static inline int sys_gfx_hline(int x, int y, int w, unsigned int rgb){
+    aso_draw_t op = { ASO_OP_HLINE, 0, (short)x, (short)y, (short)w, 1, 0, 0, rgb, 0, 0 };
+
+    return sys_gfx_draw(&op);
+}
+
+static inline int sys_gfx_vline(int x, int y, int h, unsigned int rgb){
+    aso_draw_t op = { ASO_OP_VLINE, 0, (short)x, (short)y, 1, (short)h, 0, 0, rgb, 0, 0 };
+
+    return sys_gfx_draw(&op);
+}
+
+static inline int sys_gfx_line(int x0, int y0, int x1, int y1, unsigned int rgb){
+    aso_draw_t op = { ASO_OP_LINE, 0, (short)x0, (short)y0, 0, 0, (short)x1, (short)y1, rgb, 0, 0 };
+
+    return sys_gfx_draw(&op);
+}
+
+static inline int sys_gfx_copy(int sx, int sy, int dx, int dy, int w, int h){
+    aso_draw_t op = { ASO_OP_COPY, 0, (short)dx, (short)dy, (short)w, (short)h, (short)sx, (short)sy, 0, 0, 0 };
+
+    return sys_gfx_draw(&op);
+}
+
+// Window (sx, sy) of an image 'stride' pixels wide to (dx, dy), key = RGB() left out
+static inline int sys_gfx_sprite(const unsigned int* rgb32, int stride, int sx, int sy,
+                                 int dx, int dy, int w, int h, unsigned int key){
+    aso_draw_t op = { ASO_OP_SPRITE, 0, (short)dx, (short)dy, (short)w, (short)h,
+                      (short)sx, (short)sy, key, (unsigned int)stride, rgb32 };
+
+    return sys_gfx_draw(&op);
+}
+
+static inline int sys_gfx_blend(const unsigned int* argb32, int stride, int sx, int sy,
+                                int dx, int dy, int w, int h){
+    aso_draw_t op = { ASO_OP_BLEND, 0, (short)dx, (short)dy, (short)w, (short)h,
+                      (short)sx, (short)sy, 0, (unsigned int)stride, argb32 };
+
+    return sys_gfx_draw(&op);
+}
+
+static inline void aso_cmd_init(aso_cmdbuf_t* cb, void* mem, unsigned int bytes){
+    cb->buf = (unsigned char*)mem;
+    cb->cap = bytes & ~3u;
+    cb->used = 0;
+    cb->dropped = 0;
+}
+
+// Room for one command of 'size' bytes, 0 once the buffer is full
+static inline void* aso_cmd_alloc(aso_cmdbuf_t* cb, unsigned short op, unsigned int size){
+    size = (size + 3) & ~3u;
+    if (size > 0xFFFC || cb->used + size > cb->cap) {
+        cb->dropped++;
+        return 0;
+    }
+
+    aso_cmd_t* c = (aso_cmd_t*)(cb->buf + cb->used);
+    c->op = op;
+    c->size = (unsigned short)size;
+    cb->used += size;
+    return c;
+}
+
+static inline void aso_cmd_rect(aso_cmdbuf_t* cb, unsigned short op, int x, int y, int w, int h, unsigned int rgb){
+    aso_cmd_rect_t* c = (aso_cmd_rect_t*)aso_cmd_alloc(cb, op, sizeof(aso_cmd_rect_t));
+
+    if (c) {
+        c->x = (short)x; c->y = (short)y; c->w = (short)w; c->h = (short)h;
+        c->color = rgb;
+    }
+}
+
+static inline void aso_cmd_fill(aso_cmdbuf_t* cb, int x, int y, int w, int h, unsigned int rgb){
+    aso_cmd_rect(cb, ASO_CMD_FILL, x, y, w, h, rgb);
+}
+
+static inline void aso_cmd_line(aso_cmdbuf_t* cb, int x0, int y0, int x1, int y1, unsigned int rgb){
+    aso_cmd_line_t* c = (aso_cmd_line_t*)aso_cmd_alloc(cb, ASO_CMD_LINE, sizeof(aso_cmd_line_t));
+
+    if (c) {
+        c->x0 = (short)x0; c->y0 = (short)y0; c->x1 = (short)x1; c->y1 = (short)y1;
+        c->color = rgb;
+    }
+}
+
+// n characters of s at pixel (x, y), 8x16 cells
+static inline void aso_cmd_text(aso_cmdbuf_t* cb, int x, int y, const char* s, int n,
+                                unsigned int fg, unsigned int bg, unsigned short flags){
+    if (n <= 0)
+        return;
+
+    aso_cmd_text_t* c = (aso_cmd_text_t*)aso_cmd_alloc(cb, ASO_CMD_TEXT, sizeof(aso_cmd_text_t) + (unsigned int)n);
+    if (!c)
+        return;
+
+    char* d = (char*)(c + 1);
+    c->x = (short)x; c->y = (short)y;
+    c->fg = fg; c->bg = bg;
+    c->len = (unsigned short)n;
+    c->flags = flags;
+    for (int i = 0; i < n; i++)
+        d[i] = s[i];
+}
+
+static inline void aso_cmd_sprite(aso_cmdbuf_t* cb, const unsigned int* rgb32, int stride, int sx, int sy,
+                                  int dx, int dy, int w, int h, unsigned int key){
+    aso_cmd_sprite_t* c = (aso_cmd_sprite_t*)aso_cmd_alloc(cb, ASO_CMD_SPRITE, sizeof(aso_cmd_sprite_t));
+
+    if (c) {
+        c->x = (short)dx; c->y = (short)dy; c->w = (short)w; c->h = (short)h;
+        c->sx = (short)sx; c->sy = (short)sy;
+        c->stride = (unsigned int)stride;
+        c->key = key;
+        c->src = rgb32;
+    }
+}
+
+static inline void aso_cmd_clip_push(aso_cmdbuf_t* cb, int x, int y, int w, int h){
+    aso_cmd_rect(cb, ASO_CMD_CLIP_PUSH, x, y, w, h, 0);
+}
+
+static inline void aso_cmd_clip_pop(aso_cmdbuf_t* cb){
+    aso_cmd_alloc(cb, ASO_CMD_CLIP_POP, sizeof(aso_cmd_t));
+}
+
+// Draws everything queued in one trap and empties the buffer. Returns the
+// number of commands run, negative if one was malformed.
+static inline int sys_gfx_cmds(aso_cmdbuf_t* cb){
+    int ret;
+
+    asm volatile("int $0x80"
+                : "=a"(ret)
+                : "a"(SYSCALL_GFX_CMDS), "b"(cb->buf), "c"(cb->used)
+                : "memory","cc");
+
+    cb->used = 0;
+    return ret;
+}
+
+// Processes every queued SQE in one trap, returns how many were consumed
+static inline int sys_submit(aso_ring_t* ring){
+    int ret;
+
+    asm volatile("int $0x80"
+                : "=a"(ret)
+                : "a"(SYSCALL_SUBMIT), "b"(ring)
+                : "memory","cc");
+
+    return ret;
+}
+
+static inline void aso_ring_init(aso_ring_t* ring){
+    ring->sq_head = ring->sq_tail = 0;
+    ring->cq_head = ring->cq_tail = 0;
+}
+
+// Drops completions nobody is waiting for so the kernel never stalls on a full CQ
+static inline void aso_ring_drain_cq(aso_ring_t* ring){
+    ring->cq_head = ring->cq_tail;
+}
+
+static inline int aso_ring_peek_cqe(aso_ring_t* ring, aso_cqe_t* out){
+    if (ring->cq_head == ring->cq_tail)
+        return 0;
+
+    *out = ring->cq[ring->cq_head & ASO_RING_MASK];
+    ring->cq_head++;
+
+    return 1;
+}
+
+// Submits until at most 'keep' SQEs are left. The kernel only stops short
+// (returns 0) when the CQ is full, which draining fixes; a negative return
+// means the ring indexes are bad and is passed back instead of retried.
+static inline int aso_ring_submit_until(aso_ring_t* ring, unsigned int keep){
+    while (ring->sq_tail - ring->sq_head > keep) {
+        int n = sys_submit(ring);
+
+        if (n < 0)
+            return n;
+        if (n == 0) {
+            if (ring->cq_tail - ring->cq_head < ASO_RING_ENTRIES)
+                return -3; // No progress and nothing we can free up
+            aso_ring_drain_cq(ring);
+        }
+    }
+
+    return 0;
+}
+
+// Queues one op, submitting the batch first if the SQ is full.
+// Returns 0, or the error that kept the batch from going out.
+static inline int aso_ring_queue(aso_ring_t* ring, unsigned short op, unsigned short flags,
+                                 unsigned int ebx, unsigned int ecx, unsigned int edx,
+                                 unsigned int user_data){
+    int err = aso_ring_submit_until(ring, ASO_RING_ENTRIES - 1);
+
+    if (err < 0)
+        return err;
+
+    aso_sqe_t* sqe = &ring->sq[ring->sq_tail & ASO_RING_MASK];
+
+    sqe->op = op;
+    sqe->flags = flags;
+    sqe->ebx = ebx;
+    sqe->ecx = ecx;
+    sqe->edx = edx;
+    sqe->user_data = user_data;
+
+    ring->sq_tail++;
+    return 0;
+}
+
+static inline int aso_ring_put_at(aso_ring_t* ring, int x, int y, char ch, unsigned char color){
+    unsigned int edx = ((unsigned int)(uint8_t)color << 8) | (uint8_t)ch;
+
+    return aso_ring_queue(ring, SYSCALL_PUT_AT, ASO_SQE_NOCQE, (unsigned int)x, (unsigned int)y, edx, 0);
+}
+
+static inline int aso_ring_setcursor(aso_ring_t* ring, int x, int y){
+    return aso_ring_queue(ring, SYSCALL_SETCURSOR, ASO_SQE_NOCQE, (unsigned int)x, (unsigned int)y, 0, 0);
+}
+
+// Flushes the queue and forgets any completions that were posted.
+// Returns 0, or negative if the kernel rejected the ring.
+static inline int aso_ring_flush(aso_ring_t* ring){
+    int err = aso_ring_submit_until(ring, 0);
+
+    aso_ring_drain_cq(ring);
+    return err;
+}
+
+// buf/max depend on the sub-command, returns entries copied or <0
+static inline int sys_stats(int cmd, void* buf, int max){
+    int ret;
+
+    asm volatile("int $0x80"
+                : "=a"(ret)
+                : "a"(SYSCALL_STATS), "b"(cmd), "c"(buf), "d"(max)
+                : "memory","cc");
+
+    return ret;
+}
+
+static inline int sys_prof(int cmd, unsigned int flags){
+    int ret;
+
+    asm volatile("int $0x80"
+                : "=a"(ret)
+                : "a"(SYSCALL_PROF), "b"(cmd), "c"(flags)
+                : "memory","cc");
+
+    return ret;
+}
+
+static inline int sys_prof_dump(aso_prof_sample_t* out, int max){
+    int ret;
+
+    asm volatile("int $0x80"
+                : "=a"(ret)
+                : "a"(SYSCALL_PROF), "b"(ASO_PROF_DUMP), "c"(out), "d"(max)
+                : "memory","cc");
+
+    return ret;
+}
+
+// Blocks until an event in mask arrives or timeout ticks pass, returns its type
+static inline int sys_wait_event(unsigned int mask, unsigned int timeout, aso_event_t* out){
+    int ret;
+
+    asm volatile("int $0x80"
+                : "=a"(ret)
+                : "a"(SYSCALL_WAIT_EVENT), "b"(mask), "c"(timeout), "d"(out)
+                : "memory","cc");
+
+    return ret;
+}
+
+static inline int sys_kbd_read(aso_key_event_t* out, int max){
+    int ret;
+
+    asm volatile("int $0x80"
+                : "=a"(ret)
+                : "a"(SYSCALL_KBD_READ), "b"(out), "c"(max)
+                : "memory","cc");
+
+    return ret;
+}
+
+static inline const aso_key_state_t* sys_kbd_state(void){
+    const aso_key_state_t* st;
+
+    asm volatile("int $0x80"
+                : "=a"(st)
+                : "a"(SYSCALL_KBD_STATE)
+                : "memory","cc");
+
+    return st;
+}
+
+// No syscall after the first call, the bitmap is read in place
+static inline int is_key_down(unsigned int sc){
+    static const aso_key_state_t* ks = 0;
+
+    if (!ks)
+        ks = sys_kbd_state();
+
+    return (ks->keys[(sc >> 5) & 7] >> (sc & 31)) & 1;
+}
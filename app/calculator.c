@@ -60,6 +60,9 @@ static Cell cells[] = {
 static const int CELL_COUNT = (int)(sizeof(cells)/sizeof(cells[0]));
 static int sel = 0;
 
+// Every cell write of a redraw goes out in one SYSCALL_SUBMIT
+static aso_ring_t ring;
+
 static char expr[128];   // expression tape (ASCII like "12+3*7")
 static char result[64];  // last result text
 static int  expr_len = 0;
@@ -67,17 +70,17 @@ static int  expr_len = 0;
 // helpers
 static inline int clamp(int v,int lo,int hi){ return v<lo?lo:(v>hi?hi:v); }
 
-static void draw_char(int x,int y,char ch,unsigned char attr){ sys_put_at(x,y,ch,attr); }
+static void draw_char(int x,int y,char ch,unsigned char attr){ aso_ring_put_at(&ring,x,y,ch,attr); }
 
 static void draw_text(int x,int y,const char* s,unsigned char attr){
-    for (int i=0;s[i];++i) sys_put_at(x+i,y,s[i],attr);
+    for (int i=0;s[i];++i) aso_ring_put_at(&ring,x+i,y,s[i],attr);
 }
 
 static void box(int x,int y,int w,int h,unsigned char attr){
-    for (int i=0;i<w;i++){ sys_put_at(x+i,y,'-',attr); sys_put_at(x+i,y+h-1,'-',attr); }
-    for (int j=0;j<h;j++){ sys_put_at(x,y+j,'|',attr); sys_put_at(x+w-1,y+j,'|',attr); }
-    sys_put_at(x,y,'+',attr); sys_put_at(x+w-1,y,'+',attr);
-    sys_put_at(x,y+h-1,'+',attr); sys_put_at(x+w-1,y+h-1,'+',attr);
+    for (int i=0;i<w;i++){ aso_ring_put_at(&ring,x+i,y,'-',attr); aso_ring_put_at(&ring,x+i,y+h-1,'-',attr); }
+    for (int j=0;j<h;j++){ aso_ring_put_at(&ring,x,y+j,'|',attr); aso_ring_put_at(&ring,x+w-1,y+j,'|',attr); }
+    aso_ring_put_at(&ring,x,y,'+',attr); aso_ring_put_at(&ring,x+w-1,y,'+',attr);
+    aso_ring_put_at(&ring,x,y+h-1,'+',attr); aso_ring_put_at(&ring,x+w-1,y+h-1,'+',attr);
 }
 
 static void cell_rect(int gx,int gy,int* x,int* y,int* w,int* h){
@@ -111,6 +114,7 @@ static void draw_grid(void){
 }
 
 static void draw_ui(void){
+    aso_ring_flush(&ring);
     sys_clear();
     draw_text( (W-22)/2, 1, "--- ASOS CALCULATOR ---", ATTR(C_YELLOW, C_BLACK));
     draw_text( (W-54)/2, 3, "Arrows: move  Enter: select   C: clear   =: evaluate   Q: quit", ATTR(C_LIGHTGRAY, C_BLACK));
@@ -127,7 +131,7 @@ static void draw_ui(void){
     draw_text(2, 21, "Result: ", ATTR(C_GREEN, C_BLACK));
     draw_text(10,21, result, ATTR(C_WHITE, C_BLACK));
 
-    sys_setcursor(79,24);
+    aso_ring_setcursor(&ring,79,24);
 }
 
 static void expr_clear(void){
@@ -229,12 +233,12 @@ static void apply_cell(int idx){
 
 static void redraw_tape(void){
     // expr line
-    for (int i=0;i<70;i++) sys_put_at(8+i, 19, ' ', ATTR(C_WHITE, C_BLACK));
+    for (int i=0;i<70;i++) aso_ring_put_at(&ring,8+i, 19, ' ', ATTR(C_WHITE, C_BLACK));
     draw_text(8, 19, expr, ATTR(C_WHITE, C_BLACK));
     // result line
-    for (int i=0;i<66;i++) sys_put_at(10+i, 21, ' ', ATTR(C_WHITE, C_BLACK));
+    for (int i=0;i<66;i++) aso_ring_put_at(&ring,10+i, 21, ' ', ATTR(C_WHITE, C_BLACK));
     draw_text(10, 21, result, ATTR(C_WHITE, C_BLACK));
-    sys_setcursor(79,24);
+    aso_ring_setcursor(&ring,79,24);
 }
 
 static void move_sel(int dx, int dy){
@@ -248,10 +252,11 @@ static void move_sel(int dx, int dy){
             draw_cell(sel, 0); sel=i; draw_cell(sel, 1); 
             break; 
         }
-    sys_setcursor(79,24);
+    aso_ring_setcursor(&ring,79,24);
 }
 
 void main(void){
+    aso_ring_init(&ring);
     expr_clear();
     draw_ui();
 
@@ -261,7 +266,7 @@ void main(void){
         unsigned int ch;
         while ((ch = sys_trygetchar()) != 0){
             char c = (char)ch;
-            if (c=='q' || c=='Q'){ sys_write("\nBye!\n"); sys_exit(); }
+            if (c=='q' || c=='Q'){ aso_ring_flush(&ring); sys_write("\nBye!\n"); sys_exit(); }
             else if ((unsigned char)c==KEY_LEFT)  move_sel(-1,0);
             else if ((unsigned char)c==KEY_RIGHT) move_sel(+1,0);
             else if ((unsigned char)c==KEY_UP)    move_sel(0,-1);
@@ -287,9 +292,10 @@ void main(void){
         // tiny periodic HUD refresh to keep cursor parked
         unsigned int now = sys_getticks();
         if ((int)(now - next_refresh) >= 0){
-            sys_setcursor(79,24);
+            aso_ring_setcursor(&ring,79,24);
             next_refresh += 6;
         }
+        aso_ring_flush(&ring);
         asm volatile("hlt");
     }
 }
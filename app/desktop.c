@@ -20,11 +20,14 @@
 #define C_WHITE 0xF
 #define ATTR(fg, bg) (((bg) << 4) | ((fg) & 0x0F))
 
+// Cell writes are batched and flushed once per loop iteration
+static aso_ring_t ring;
+
 static inline int clamp(int v, int lo, int hi) {
     return v < lo ? lo : (v > hi ? hi : v);
 }
 static void put(int x, int y, char ch, unsigned char a) {
-    sys_put_at(x, y, ch, a);
+    aso_ring_put_at(&ring, x, y, ch, a);
 }
 static void text(int x, int y, const char* s, unsigned char a) {
     for (int i = 0; s[i]; ++i)
@@ -173,6 +176,7 @@ static void draw_files(int sel) {
 
 // ---------- Main ----------
 void main(void) {
+    aso_ring_init(&ring);
     sys_clear();
     sys_mouse_show(0);  // hide cursor sprite just in case
     int cols = 80, rows = 25;
@@ -200,15 +204,22 @@ void main(void) {
     draw_files(sel_file);
     status("Welcome. Pick an app or a .txt file.");
 
-    sys_setcursor(W - 1, H - 1);
+    aso_ring_setcursor(&ring, W - 1, H - 1);
 
     unsigned int refresh = sys_getticks() + 8;
+    aso_event_t ev;
 
     while (1) {
-        unsigned int ch = sys_trygetchar();
+        // Sleep in the kernel until a key or the next cursor refresh
+        int wait = (int)(refresh - sys_getticks());
+        aso_ring_flush(&ring);
+        sys_wait_event(1u << ASO_EV_KEY_DOWN, wait > 0 ? (unsigned int)wait : 0, &ev);
+
+        unsigned int ch = (ev.type == ASO_EV_KEY_DOWN) ? ev.data : 0;
         if (ch) {
             char c = (char)ch;
             if (c == 'q' || c == 'Q') {
+                aso_ring_flush(&ring);
                 sys_write("\nBye!\n");
                 sys_exit();
             }
@@ -254,6 +265,7 @@ void main(void) {
             } else if (c == '\n') {
                 if (focus == 0) {
                     // launch selected app
+                    aso_ring_flush(&ring);
                     sys_write("Launching ");
                     sys_write(apps[sel_app].label);
                     sys_write("...\n");
@@ -270,6 +282,7 @@ void main(void) {
                         char cmd[64];
                         strcpy(cmd, "textedit.bin ");
                         strcat(cmd, file_names[sel_file]);
+                        aso_ring_flush(&ring);
                         sys_write("Editing ");
                         sys_write(file_names[sel_file]);
                         sys_write("...\n");
@@ -289,9 +302,8 @@ void main(void) {
 
         unsigned now = sys_getticks();
         if ((int)(now - refresh) >= 0) {
-            sys_setcursor(W - 1, H - 1);
+            aso_ring_setcursor(&ring, W - 1, H - 1);
             refresh += 8;
         }
-        asm volatile("hlt");
     }
 }
@@ -2,11 +2,16 @@
 #include "../lib/string.h"
 #include "asoapi.h"
 
-#define MAX_W 1024
-#define MAX_H 768
 #define RGB(r, g, b) (((unsigned)(r) & 0xFF) << 16 | ((unsigned)(g) & 0xFF) << 8 | ((unsigned)(b) & 0xFF))
+#define FIELD_BG RGB(12, 14, 18)
+#define GRID_COL RGB(28, 32, 38)
 
-static unsigned int backbuf[MAX_W * MAX_H];
+// The kernel draws the frame from this command list, no backbuffer needed
+#define CMD_BYTES (64 * 1024)
+#define CMD_SLACK 256 // Worst case for one cell (clip, floor, grid, piece) or the HUD
+
+static unsigned int cmd_mem[CMD_BYTES / 4];
+static aso_cmdbuf_t cb;
 static int G_W = 0, G_H = 0;
 
 static unsigned int rng_state = 2463534242u;
@@ -35,39 +40,26 @@ static pt apple;
 static int score = 0, hi_score = 0;
 static int paused = 0;
 
-static inline void pset(int x, int y, unsigned int rgb) {
-    if ((unsigned)x < (unsigned)G_W && (unsigned)y < (unsigned)G_H)
-        backbuf[y * G_W + x] = rgb;
+// Cells changed by the last step, -1 means the whole frame has to be redrawn
+static pt damage[3];
+static int damage_count = -1;
+
+// Sends what's queued so far once the buffer can't take another cell. Never
+// called between a clip push and its pop, the clip ends with the submit.
+static void cmd_reserve(void) {
+    if (cb.used + CMD_SLACK > cb.cap)
+        sys_gfx_cmds(&cb);
 }
 static void fill_rect(int x, int y, int w, int h, unsigned int rgb) {
-    int x2 = x + w, y2 = y + h;
-    if (x < 0)
-        x = 0;
-    if (y < 0)
-        y = 0;
-    if (x2 > G_W)
-        x2 = G_W;
-    if (y2 > G_H)
-        y2 = G_H;
-    if (x >= x2 || y >= y2)
-        return;
-    for (int j = y; j < y2; ++j) {
-        unsigned int* row = &backbuf[j * G_W];
-        for (int i = x; i < x2; ++i)
-            row[i] = rgb;
-    }
+    aso_cmd_fill(&cb, x, y, w, h, rgb);
 }
 static void frame_rect(int x, int y, int w, int h, unsigned int rgb) {
     if (w <= 0 || h <= 0)
         return;
-    for (int i = 0; i < w; i++) {
-        pset(x + i, y, rgb);
-        pset(x + i, y + h - 1, rgb);
-    }
-    for (int j = 0; j < h; j++) {
-        pset(x, y + j, rgb);
-        pset(x + w - 1, y + j, rgb);
-    }
+    fill_rect(x, y, w, 1, rgb);
+    fill_rect(x, y + h - 1, w, 1, rgb);
+    fill_rect(x, y, 1, h, rgb);
+    fill_rect(x + w - 1, y, 1, h, rgb);
 }
 static inline void draw_cell_px(int cx, int cy, unsigned int rgb, int is_head) {
     int x = FX0 + cx * CELL;
@@ -85,14 +77,10 @@ static inline void draw_cell_px(int cx, int cy, unsigned int rgb, int is_head) {
     unsigned int light = RGB(255, 255, 255);
 
     fill_rect(x + pad, y + pad, w, h, core);
-    for (int i = 0; i < w; i++)
-        pset(x + pad + i, y + pad, (core & 0xFEFEFE) | 0x101010);
-    for (int j = 0; j < h; j++)
-        pset(x + pad, y + pad + j, (core & 0xFEFEFE) | 0x101010);
-    for (int i = 0; i < w; i++)
-        pset(x + pad + i, y + pad + h - 1, shade);
-    for (int j = 0; j < h; j++)
-        pset(x + pad + w - 1, y + pad + j, shade);
+    fill_rect(x + pad, y + pad, w, 1, (core & 0xFEFEFE) | 0x101010);
+    fill_rect(x + pad, y + pad, 1, h, (core & 0xFEFEFE) | 0x101010);
+    fill_rect(x + pad, y + pad + h - 1, w, 1, shade);
+    fill_rect(x + pad + w - 1, y + pad, 1, h, shade);
 
     if (is_head)
         frame_rect(x + pad, y + pad, w, h, light);
@@ -115,28 +103,20 @@ static void save_hiscore_if_needed(void) {
     }
 }
 
-static void put_str_clipped(int col, int row, const char* s, unsigned char attr) {
-    int cols = 80, rows = 25;
-    sys_getsize(&cols, &rows);
-    if (row < 0 || row >= rows)
-        return;
+// Text on the 8x16 character grid, the kernel clips it to the screen
+static void put_str(int col, int row, const char* s) {
     if (col < 0)
         col = 0;
-    for (int i = 0; s[i] && col + i < cols; ++i)
-        sys_put_at(col + i, row, s[i], attr);
+    aso_cmd_text(&cb, col * 8, row * 16, s, (int)strlen(s), RGB(255, 255, 255), 0, ASO_TEXT_FG_ONLY);
 }
 static void hud_draw_panel_and_text(void) {
     fill_rect(0, 0, G_W, HUD_PX, RGB(18, 20, 24));
     frame_rect(0, 0, G_W, HUD_PX, RGB(60, 60, 60));
 
-    int cols = 80, rows = 25;
-    sys_getsize(&cols, &rows);
+    int cols = G_W / 8;
 
     const char* title = "SNAKE [Arrows=move P=pause  Q=quit]";
-    int tx = (cols - (int)strlen(title)) / 2;
-    if (tx < 0)
-        tx = 0;
-    put_str_clipped(tx, 0, title, 0x0F);
+    put_str((cols - (int)strlen(title)) / 2, 0, title);
 
     char s1[12], s2[12], line[96];
     s1[0] = s2[0] = line[0] = 0;
@@ -146,9 +126,7 @@ static void hud_draw_panel_and_text(void) {
     strcat(line, s1);
     strcat(line, "    Record: ");
     strcat(line, s2);
-    put_str_clipped(2, 1, line, 0x0F);
-
-    sys_setcursor(cols - 1, rows - 1);
+    put_str(2, 1, line);
 }
 
 static void compute_layout(void) {
@@ -227,9 +205,15 @@ static void reset_game(void) {
     snake[2] = (pt){cx - 2, cy};
     spawn_apple();
 }
+static void damage_cell(pt p) {
+    damage[damage_count++] = p;
+}
+
 static int step(void) {
-    if (paused)
+    if (paused) {
+        damage_count = 0;
         return 1;
+    }
 
     pt head = snake[0];
     head.x += dirx;
@@ -247,6 +231,12 @@ static int step(void) {
             len++;
         score++;
         spawn_apple();
+        damage_count = -1; // Apple and score moved too
+    } else {
+        damage_count = 0;
+        damage_cell(snake[len - 1]); // Tail leaves
+        damage_cell(snake[0]);       // Old head loses its frame
+        damage_cell(head);
     }
     for (int i = len - 1; i > 0; --i)
         snake[i] = snake[i - 1];
@@ -254,24 +244,60 @@ static int step(void) {
     return 1;
 }
 
+static void draw_grid_line_x(int c) {
+    if (c > 0 && c < COLS)
+        fill_rect(FX0 + c * CELL, FY0, 1, ROWS * CELL, GRID_COL);
+}
+static void draw_grid_line_y(int r) {
+    if (r > 0 && r < ROWS)
+        fill_rect(FX0, FY0 + r * CELL, COLS * CELL, 1, GRID_COL);
+}
+
+// Redraws one grid cell from scratch. The clip keeps the grid lines (drawn
+// across the whole field) and anything else inside the cell.
+static void draw_cell_area(pt p) {
+    int x = FX0 + p.x * CELL;
+    int y = FY0 + p.y * CELL;
+
+    cmd_reserve();
+    aso_cmd_clip_push(&cb, x, y, CELL, CELL);
+    fill_rect(x, y, CELL, CELL, FIELD_BG);
+    if (CELL >= 16) {
+        draw_grid_line_x(p.x);
+        draw_grid_line_y(p.y);
+    }
+
+    if (apple.x == p.x && apple.y == p.y)
+        draw_cell_px(p.x, p.y, RGB(215, 55, 45), 0);
+    for (int i = 0; i < len; i++) {
+        if (snake[i].x == p.x && snake[i].y == p.y) {
+            draw_cell_px(p.x, p.y, i == 0 ? RGB(90, 220, 110) : RGB(60, 180, 85), i == 0);
+            break;
+        }
+    }
+    aso_cmd_clip_pop(&cb);
+}
+
 static void draw_everything(void) {
-    fill_rect(0, 0, G_W, G_H, RGB(12, 14, 18));
+    if (damage_count >= 0) {
+        for (int i = 0; i < damage_count; i++)
+            draw_cell_area(damage[i]);
+        if (damage_count > 0)
+            sys_gfx_cmds(&cb);
+        damage_count = -1;
+        return;
+    }
+
+    fill_rect(0, 0, G_W, G_H, FIELD_BG);
 
     frame_rect(FX0 - 2, FY0 - 2, COLS * CELL + 4, ROWS * CELL + 4, RGB(220, 220, 220));
     frame_rect(FX0 - 1, FY0 - 1, COLS * CELL + 2, ROWS * CELL + 2, RGB(80, 80, 80));
 
     if (CELL >= 16) {
-        unsigned int gridCol = RGB(28, 32, 38);
-        for (int c = 1; c < COLS; ++c) {
-            int x = FX0 + c * CELL;
-            for (int y = FY0; y < FY0 + ROWS * CELL; ++y)
-                pset(x, y, gridCol);
-        }
-        for (int r = 1; r < ROWS; ++r) {
-            int y = FY0 + r * CELL;
-            for (int x = FX0; x < FX0 + COLS * CELL; ++x)
-                pset(x, y, gridCol);
-        }
+        for (int c = 1; c < COLS; ++c)
+            draw_grid_line_x(c);
+        for (int r = 1; r < ROWS; ++r)
+            draw_grid_line_y(r);
     }
 
     draw_cell_px(apple.x, apple.y, RGB(215, 55, 45), 0);
@@ -279,12 +305,13 @@ static void draw_everything(void) {
     for (int i = 0; i < len; i++) {
         int head = (i == 0);
         unsigned int col = head ? RGB(90, 220, 110) : RGB(60, 180, 85);
+        cmd_reserve();
         draw_cell_px(snake[i].x, snake[i].y, col, head);
     }
 
+    cmd_reserve();
     hud_draw_panel_and_text();
-
-    sys_gfx_blit(backbuf);
+    sys_gfx_cmds(&cb);
 }
 
 void main(void) {
@@ -297,23 +324,19 @@ void main(void) {
         }
         sys_exit();
     }
-    int W = (int)((info >> 16) & 0xFFFF);
-    int H = (int)(info & 0xFFFF);
-    if (W > MAX_W || H > MAX_H) {
-        sys_clear();
-        sys_write("Resolution too big (requires <= 1024x768).\n");
-        sys_write("Press ENTER to exit...\n");
-        while (sys_getchar() != '\n') {
-        }
-        sys_exit();
-    }
-    G_W = W;
-    G_H = H;
+    G_W = (int)((info >> 16) & 0xFFFF);
+    G_H = (int)(info & 0xFFFF);
 
     sys_mouse_show(0);
     sys_gfx_clear(RGB(0, 0, 0));
     sys_clear();
 
+    int cols = 80, rows = 25;
+    sys_getsize(&cols, &rows);
+    sys_setcursor(cols - 1, rows - 1);
+
+    aso_cmd_init(&cb, cmd_mem, sizeof(cmd_mem));
+
     load_hiscore();
     compute_layout();
     reset_game();
@@ -326,10 +349,13 @@ void main(void) {
 
     draw_everything();
 
+    aso_event_t ev;
+
     while (1) {
-        unsigned int ch;
-        while ((ch = sys_trygetchar()) != 0) {
-            char c = (char)ch;
+        // Sleep until a key press or the next step is due
+        int wait = (int)(next_step - sys_getticks());
+        if (sys_wait_event(1u << ASO_EV_KEY_DOWN, wait > 0 ? (unsigned int)wait : 0, &ev) == ASO_EV_KEY_DOWN) {
+            char c = (char)ev.data;
             if (c == 'q' || c == 'Q') {
                 save_hiscore_if_needed();
                 sys_exit();
@@ -375,8 +401,7 @@ void main(void) {
                 strcpy(buf2, "Record: ");
                 strcat(buf2, nh);
 
-                int cols = 80, rows = 25;
-                sys_getsize(&cols, &rows);
+                int cols = G_W / 8;
                 int cx1 = (cols - (int)strlen(line1)) / 2;
                 if (cx1 < 0)
                     cx1 = 0;
@@ -387,11 +412,11 @@ void main(void) {
                 if (cx3 < 0)
                     cx3 = 0;
 
-                put_str_clipped(cx1, 3, line1, 0x0F);
-                put_str_clipped(cx2, 5, buf1, 0x0F);
-                put_str_clipped(cx3, 6, buf2, 0x0F);
+                put_str(cx1, 3, line1);
+                put_str(cx2, 5, buf1);
+                put_str(cx3, 6, buf2);
 
-                sys_gfx_blit(backbuf);
+                sys_gfx_cmds(&cb);
 
                 while (sys_getchar() != '\n') {
                 }
@@ -405,7 +430,5 @@ void main(void) {
             if ((int)(now - next_step) >= 0)
                 next_step = now + step_ticks;
         }
-
-        asm volatile("hlt");
     }
 }
@@ -1,5 +1,283 @@
 #include "asoapi.h"
 #include "../lib/string.h"
+#include "../lib/stdlib.h"
+
+static const char* syscall_names[] = {
+    "unknown", "write", "exit", "exec", "getchar", "clear", "writefile",
+    "listfiles", "readfile", "getarg", "put_at", "setcursor", "trygetchar",
+    "getticks", "sleep", "getsize", "blit", "mouse_get", "mouse_show",
+    "enumfiles", "gfx_info", "gfx_clear", "gfx_putpx", "gfx_blit", "submit",
+    "stats", "prof", "wait_event", "kbd_read", "kbd_state", "gfx_blit_rect",
+    "gfx_blit_native", "gfx_draw", "gfx_cmds",
+};
+#define SYSCALL_NAMES (int)(sizeof(syscall_names) / sizeof(syscall_names[0]))
+
+static aso_sysstat_t stats[ASO_STATS_MAX];
+static aso_systrace_t trace[ASO_TRACE_ENTRIES];
+
+static const char* syscall_name(unsigned int num) {
+    return (num < (unsigned int)SYSCALL_NAMES) ? syscall_names[num] : "?";
+}
+
+// Right-aligned in a column of 'width' chars
+static void write_col(const char* s, int width) {
+    int pad = width - (int)strlen(s);
+
+    while (pad-- > 0)
+        sys_write(" ");
+    sys_write(s);
+}
+
+static void write_name(const char* s, int width) {
+    int pad = width - (int)strlen(s);
+
+    sys_write(s);
+    while (pad-- > 0)
+        sys_write(" ");
+}
+
+static void print_stat_row(const char* name, const aso_sysstat_t* st) {
+    char tmp[24];
+
+    // Scale both down until the division fits in 32 bits
+    unsigned long long total = st->total_cycles;
+    unsigned int calls = st->calls;
+
+    while ((total >> 32) && calls > 1) {
+        total >>= 1;
+        calls >>= 1;
+    }
+
+    write_name(name, 12);
+    write_col(ulltoa(st->calls, tmp, 10), 10);
+    write_col(ulltoa((unsigned int)total / calls, tmp, 10), 11);
+    write_col(ulltoa(st->max_cycles, tmp, 10), 11);
+    write_col(ulltoa(st->total_cycles, tmp, 10), 15);
+    sys_write("\n");
+}
+
+static void print_stats(void) {
+    int n = sys_stats(ASO_STATS_GET, stats, ASO_STATS_MAX);
+
+    if (n <= 0) {
+        sys_write("No stats available.\n");
+        return;
+    }
+
+    sys_write("syscall          calls    avg cyc    max cyc      total cyc\n");
+    for (int i = 0; i < n; i++) {
+        if (stats[i].calls)
+            print_stat_row(syscall_name((unsigned int)i), &stats[i]);
+    }
+}
+
+static const char* softirq_names[ASO_SOFTIRQS] = { "cursor", "flush" };
+
+// Handler time per IRQ line, then the deferred work each one raised
+static void print_irq_stats(void) {
+    int n = sys_stats(ASO_STATS_IRQ, stats, 16 + ASO_SOFTIRQS);
+    char name[16], tmp[8];
+
+    if (n <= 0) {
+        sys_write("No stats available.\n");
+        return;
+    }
+
+    sys_write("handler          calls    avg cyc    max cyc      total cyc\n");
+    for (int i = 0; i < n; i++) {
+        if (!stats[i].calls)
+            continue;
+
+        if (i < 16) {
+            strcpy(name, "irq");
+            strcat(name, itoa(i, tmp, 10));
+        } else if (softirq_names[i - 16]) {
+            strcpy(name, "soft:");
+            strcat(name, softirq_names[i - 16]);
+        } else {
+            strcpy(name, "soft");
+            strcat(name, itoa(i - 16, tmp, 10));
+        }
+        print_stat_row(name, &stats[i]);
+    }
+}
+
+// Most recent records only, the console can't hold the whole ring
+#define TRACE_SHOW 20
+
+static void print_trace(void) {
+    int n = sys_stats(ASO_STATS_TRACE_READ, trace, ASO_TRACE_ENTRIES);
+    char tmp[24];
+
+    if (n <= 0) {
+        sys_write("Trace is empty (use 'trace on').\n");
+        return;
+    }
+
+    sys_write("tsc (low)   syscall             ebx        res    cycles\n");
+    for (int i = (n > TRACE_SHOW) ? n - TRACE_SHOW : 0; i < n; i++) {
+        write_col(ulltoa((unsigned int)trace[i].tsc, tmp, 16), 9);
+        sys_write("   ");
+        write_name(syscall_name(trace[i].num), 12);
+        write_col(ulltoa(trace[i].ebx, tmp, 16), 11);
+        write_col(itoa((int)trace[i].res, tmp, 10), 11);
+        write_col(ulltoa(trace[i].cycles, tmp, 10), 10);
+        sys_write("\n");
+    }
+}
+
+// Profiler report, symbols come from asos.sym generated at build time
+#define SYM_FILE_MAX 65536
+#define SYM_MAX 2048
+#define PROF_ROWS 512
+#define PROF_SHOW 16
+#define APP_BASE 0x00300000
+
+static char symfile[SYM_FILE_MAX];
+static unsigned int sym_addr[SYM_MAX];
+static const char* sym_name[SYM_MAX];
+static const char* sym_image[SYM_MAX];
+static int sym_count = 0;
+
+static aso_prof_sample_t samples[ASO_PROF_SLOTS];
+
+typedef struct {
+    const char* image;
+    const char* name;
+    unsigned int self, total;
+} prof_row_t;
+
+static prof_row_t rows[PROF_ROWS];
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Splits the file in place: "# image" headers, then "addr name" lines
+static void load_symbols(void) {
+    int size = sys_readfile("asos.sym", symfile, SYM_FILE_MAX - 1);
+    const char* image = "?";
+
+    sym_count = 0;
+    if (size <= 0)
+        return;
+    // readfile writes the whole file whatever max says; make_symtab.py keeps
+    // it under SYM_FILE_MAX so it fits, the terminator must too
+    if (size > SYM_FILE_MAX - 1)
+        size = SYM_FILE_MAX - 1;
+    symfile[size] = 0;
+
+    char* p = symfile;
+    while (*p && sym_count < SYM_MAX) {
+        char* line = p;
+
+        while (*p && *p != '\n') p++;
+        if (*p) *p++ = 0;
+
+        if (line[0] == '#') {
+            image = line + 2;
+            continue;
+        }
+
+        unsigned int addr = 0;
+        int d;
+        while ((d = hex_digit(*line)) >= 0) {
+            addr = (addr << 4) | (unsigned int)d;
+            line++;
+        }
+        if (*line != ' ')
+            continue;
+
+        sym_addr[sym_count] = addr;
+        sym_name[sym_count] = line + 1;
+        sym_image[sym_count] = image;
+        sym_count++;
+    }
+}
+
+static void resolve(unsigned int eip, const char* app, const char** image, const char** name) {
+    unsigned int best = 0;
+
+    *image = (eip < APP_BASE) ? "kernel" : app;
+    *name = "?";
+
+    for (int i = 0; i < sym_count; i++) {
+        if (strcmp(sym_image[i], *image) || sym_addr[i] > eip || sym_addr[i] < best)
+            continue;
+        best = sym_addr[i];
+        *name = sym_name[i];
+    }
+}
+
+static void print_prof(void) {
+    int n = sys_prof_dump(samples, ASO_PROF_SLOTS);
+    int nrows = 0;
+    unsigned int total_samples = 0;
+    char tmp[24];
+
+    if (n <= 0) {
+        sys_write("No samples (use 'prof start [cg]' then 'prof stop').\n");
+        return;
+    }
+
+    load_symbols();
+
+    // Fold raw addresses into (image, symbol) rows
+    for (int i = 0; i < n; i++) {
+        const char* image;
+        const char* name;
+        int r;
+
+        resolve(samples[i].eip, samples[i].app, &image, &name);
+        total_samples += samples[i].self;
+
+        for (r = 0; r < nrows; r++)
+            if (rows[r].name == name && !strcmp(rows[r].image, image))
+                break;
+
+        if (r == nrows) {
+            if (nrows == PROF_ROWS)
+                continue;
+            rows[r].image = image;
+            rows[r].name = name;
+            rows[r].self = rows[r].total = 0;
+            nrows++;
+        }
+        rows[r].self += samples[i].self;
+        rows[r].total += samples[i].total;
+    }
+
+    sys_write(" self%   self  total  image          symbol\n");
+    for (int shown = 0; shown < PROF_SHOW && shown < nrows; shown++) {
+        int top = shown;
+
+        for (int r = shown + 1; r < nrows; r++)
+            if (rows[r].self > rows[top].self)
+                top = r;
+
+        prof_row_t t = rows[shown];
+        rows[shown] = rows[top];
+        rows[top] = t;
+
+        unsigned int pct = total_samples ? rows[shown].self * 100u / total_samples : 0;
+        write_col(ulltoa(pct, tmp, 10), 5);
+        write_col(ulltoa(rows[shown].self, tmp, 10), 7);
+        write_col(ulltoa(rows[shown].total, tmp, 10), 7);
+        sys_write("  ");
+        write_name(rows[shown].image, 15);
+        sys_write(rows[shown].name);
+        sys_write("\n");
+    }
+
+    sys_write("Samples: ");
+    sys_write(ulltoa(total_samples, tmp, 10));
+    if (!sym_count)
+        sys_write(" (asos.sym missing, symbols unresolved)");
+    sys_write("\n");
+}
 
 void main(void) {
     char buf[64];
@@ -29,7 +307,8 @@ void main(void) {
         if (buf[0] == 0) continue;
 
         if (!strcmp(buf, "help")) {
-            sys_write("Commands: help, clear, run <app>, exit\n");
+            sys_write("Commands: help, clear, run <app>, files, stats [irq|reset], trace [on|off],\n");
+            sys_write("          prof [start [cg]|stop], exit\n");
         }
         else if (!strcmp(buf, "clear")) {
             sys_clear();
@@ -44,6 +323,39 @@ void main(void) {
         else if (!strcmp(buf, "files")) {
             sys_listfiles();
         }
+        else if (!strcmp(buf, "stats")) {
+            print_stats();
+        }
+        else if (!strcmp(buf, "stats irq")) {
+            print_irq_stats();
+        }
+        else if (!strcmp(buf, "stats reset")) {
+            sys_stats(ASO_STATS_RESET, 0, 0);
+        }
+        else if (!strcmp(buf, "trace on")) {
+            sys_stats(ASO_STATS_TRACE_ON, 0, 0);
+        }
+        else if (!strcmp(buf, "trace off")) {
+            sys_stats(ASO_STATS_TRACE_OFF, 0, 0);
+        }
+        else if (!strcmp(buf, "trace")) {
+            print_trace();
+        }
+        else if (!strcmp(buf, "prof start")) {
+            sys_prof(ASO_PROF_START, 0);
+        }
+        else if (!strcmp(buf, "prof start cg")) {
+            sys_prof(ASO_PROF_START, ASO_PROF_CALLGRAPH);
+        }
+        else if (!strcmp(buf, "prof stop")) {
+            char tmp[16];
+            sys_write("Samples taken: ");
+            sys_write(itoa(sys_prof(ASO_PROF_STOP, 0), tmp, 10));
+            sys_write("\n");
+        }
+        else if (!strcmp(buf, "prof")) {
+            print_prof();
+        }
         else {
             sys_write("Unknown command.\n");
         }
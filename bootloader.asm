@@ -15,6 +15,8 @@ jmp start
 %endif
 
 KERNEL_LBA       equ 5
+KERNEL_BUF_SEG   equ 0x1000                ; 0x00010000 physical, up to 0x80000 (896 sectors)
+KERNEL_CHUNK     equ 64                    ; Sectors per INT 13h read (32 KiB, no 64 KiB wrap)
 
 ; Choose a VBE mode that your BIOS supports with 32 bpp.
 %ifndef VBE_MODE
@@ -39,9 +41,9 @@ boot_drive db 0
 kernel_dap:
     db 0x10                 ; Size of DAP (16 bytes)
     db 0x00
-    dw KERNEL_SECTORS       ; Number of sectors to read
-    dw 0x0000               ; Offset buffer (0x9000:0000 -> 0x00090000)
-    dw 0x9000               ; Segment buffer
+    dw 0                    ; Number of sectors to read, set per chunk
+    dw 0x0000               ; Offset buffer
+    dw KERNEL_BUF_SEG       ; Segment buffer, advanced per chunk
     dd KERNEL_LBA           ; Starting LBA
     dd 0x00000000           ; Upper 32 bits of LBA (unused)
 
@@ -123,13 +125,32 @@ start:
     pop es
     pop ds
 
-    ; Read the kernel from disk using INT 13h extensions (AH=42h) into 0x00090000.
+    ; Read the kernel from disk using INT 13h extensions (AH=42h) into 0x00010000.
+    ; BIOSes cap a single read at 127 sectors, so go in KERNEL_CHUNK pieces.
+    mov cx, KERNEL_SECTORS
+.read_chunk:
+    mov ax, cx
+    cmp ax, KERNEL_CHUNK
+    jbe .chunk_ok
+    mov ax, KERNEL_CHUNK
+.chunk_ok:
+    mov [kernel_dap + 2], ax
+    pusha
     mov si, kernel_dap
     mov ah, 0x42
     mov dl, [boot_drive]
     int 0x13
+    popa                        ; Leaves CF alone
     jc disk_error
 
+    sub cx, ax
+    add [kernel_dap + 8], ax    ; Next LBA
+    adc word [kernel_dap + 10], 0
+    shl ax, 5                   ; Sectors -> paragraphs
+    add [kernel_dap + 6], ax    ; Next segment
+    test cx, cx
+    jnz .read_chunk
+
     ; Enter protected mode.
     cli
     lgdt [gdt_descriptor]
@@ -150,8 +171,8 @@ pm_entry:
     mov ss, ax
     mov esp, 0x80000
 
-    ; Copy kernel from 0x00090000 → 0x00100000.
-    mov esi, 0x00090000
+    ; Copy kernel from 0x00010000 → 0x00100000.
+    mov esi, KERNEL_BUF_SEG * 16
     mov edi, 0x00100000
     mov ecx, (KERNEL_SECTORS * 512) / 4
     cld
@@ -0,0 +1,149 @@
+#include "acpi.h"
+#include "../lib/string.h"
+#include <stdint.h>
+
+#define BDA_EBDA_SEG ((const uint16_t*)0x040E)
+
+#define MADT_LAPIC       0
+#define MADT_IOAPIC      1
+#define MADT_ISO         2
+#define MADT_LAPIC_ADDR  5
+
+#define MADT_PCAT_COMPAT 0x01
+#define LAPIC_ENABLED    0x01
+
+typedef struct {
+    char sig[8];
+    uint8_t checksum;
+    char oem[6];
+    uint8_t rev;
+    uint32_t rsdt;
+} __attribute__((packed)) rsdp_t;
+
+typedef struct {
+    char sig[4];
+    uint32_t length;
+    uint8_t rev;
+    uint8_t checksum;
+    char oem[6];
+    char oem_table[8];
+    uint32_t oem_rev;
+    uint32_t creator;
+    uint32_t creator_rev;
+} __attribute__((packed)) sdt_header_t;
+
+typedef struct {
+    sdt_header_t h;
+    uint32_t lapic_addr;
+    uint32_t flags;
+} __attribute__((packed)) madt_t;
+
+static acpi_madt_info_t M;
+
+static int checksum_ok(const void* p, uint32_t len) {
+    const uint8_t* b = (const uint8_t*)p;
+    uint8_t sum = 0;
+
+    for (uint32_t i = 0; i < len; i++)
+        sum += b[i];
+
+    return sum == 0;
+}
+
+static const rsdp_t* scan_rsdp(uint32_t start, uint32_t len) {
+    for (uint32_t a = start; a < start + len; a += 16) {
+        const rsdp_t* r = (const rsdp_t*)a;
+
+        if (!memcmp(r->sig, "RSD PTR ", 8) && checksum_ok(r, 20))
+            return r;
+    }
+
+    return 0;
+}
+
+static const rsdp_t* find_rsdp(void) {
+    uint32_t ebda = (uint32_t)(*BDA_EBDA_SEG) << 4;
+    const rsdp_t* r = 0;
+
+    if (ebda)
+        r = scan_rsdp(ebda, 1024);
+    if (!r)
+        r = scan_rsdp(0x000E0000, 0x20000);
+
+    return r;
+}
+
+static const madt_t* find_madt(void) {
+    const rsdp_t* rsdp = find_rsdp();
+    if (!rsdp)
+        return 0;
+
+    const sdt_header_t* rsdt = (const sdt_header_t*)rsdp->rsdt;
+    if (memcmp(rsdt->sig, "RSDT", 4) || !checksum_ok(rsdt, rsdt->length))
+        return 0;
+
+    const uint32_t* entries = (const uint32_t*)(rsdt + 1);
+    uint32_t n = (rsdt->length - sizeof(sdt_header_t)) / 4;
+
+    for (uint32_t i = 0; i < n; i++) {
+        const sdt_header_t* h = (const sdt_header_t*)entries[i];
+
+        if (!memcmp(h->sig, "APIC", 4) && checksum_ok(h, h->length))
+            return (const madt_t*)h;
+    }
+
+    return 0;
+}
+
+int acpi_parse_madt(void) {
+    const madt_t* madt = find_madt();
+    if (!madt)
+        return -1;
+
+    memset(&M, 0, sizeof(M));
+    M.lapic_addr = madt->lapic_addr;
+    M.has_8259 = (madt->flags & MADT_PCAT_COMPAT) ? 1 : 0;
+
+    // Identity mapping until the MADT says otherwise
+    for (int i = 0; i < 16; i++) {
+        M.isa[i].gsi = (uint32_t)i;
+        M.isa[i].flags = 0;
+    }
+
+    const uint8_t* p = (const uint8_t*)(madt + 1);
+    const uint8_t* end = (const uint8_t*)madt + madt->h.length;
+
+    while (p + 2 <= end && p[1] >= 2) {
+        switch (p[0]) {
+        case MADT_LAPIC:
+            if ((p[4] & LAPIC_ENABLED) && M.cpu_count < ACPI_MAX_CPUS)
+                M.cpu_apic_id[M.cpu_count++] = p[3];
+            break;
+        case MADT_IOAPIC:
+            if (M.ioapic_count < ACPI_MAX_IOAPICS) {
+                acpi_ioapic_t* io = &M.ioapic[M.ioapic_count++];
+
+                io->id = p[2];
+                io->addr = *(const uint32_t*)(p + 4);
+                io->gsi_base = *(const uint32_t*)(p + 8);
+            }
+            break;
+        case MADT_ISO:
+            if (p[2] == 0 && p[3] < 16) { // Bus 0 = ISA
+                M.isa[p[3]].gsi = *(const uint32_t*)(p + 4);
+                M.isa[p[3]].flags = *(const uint16_t*)(p + 8);
+            }
+            break;
+        case MADT_LAPIC_ADDR:
+            M.lapic_addr = (uint32_t)*(const uint64_t*)(p + 4);
+            break;
+        }
+        p += p[1];
+    }
+
+    return (M.ioapic_count > 0) ? 0 : -2;
+}
+
+const acpi_madt_info_t* acpi_madt(void) {
+    return &M;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+#define ACPI_MAX_CPUS 16
+#define ACPI_MAX_IOAPICS 4
+
+typedef struct {
+    uint32_t addr;
+    uint32_t gsi_base;
+    uint8_t id;
+} acpi_ioapic_t;
+
+// ISA IRQ -> GSI, flags are the MPS INTI polarity/trigger bits
+typedef struct {
+    uint32_t gsi;
+    uint16_t flags;
+} acpi_irq_override_t;
+
+typedef struct {
+    uint32_t lapic_addr;
+    int has_8259; // PCAT_COMPAT, a legacy PIC is wired up as well
+
+    int cpu_count;
+    uint8_t cpu_apic_id[ACPI_MAX_CPUS];
+
+    int ioapic_count;
+    acpi_ioapic_t ioapic[ACPI_MAX_IOAPICS];
+
+    acpi_irq_override_t isa[16];
+} acpi_madt_info_t;
+
+int acpi_parse_madt(void);
+const acpi_madt_info_t* acpi_madt(void);
@@ -0,0 +1,153 @@
+#include "apic.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "idt.h"
+#include "io.h"
+#include <stdint.h>
+
+#define CPUID_EDX_APIC   (1u << 9)
+#define MSR_APIC_BASE    0x1B
+#define APIC_BASE_ENABLE (1u << 11)
+#define SVR_ENABLE       0x100
+
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WIN    0x10
+#define IOAPIC_VER    0x01
+#define IOAPIC_REDTBL 0x10 // Two registers per entry
+
+#define RED_ACTIVE_LOW (1u << 13)
+#define RED_LEVEL      (1u << 15)
+#define RED_MASKED     (1u << 16)
+
+// MPS INTI flags from the MADT overrides
+#define INTI_POLARITY_MASK 0x3
+#define INTI_ACTIVE_LOW    0x3
+#define INTI_TRIGGER_MASK  0xC
+#define INTI_LEVEL         0xC
+
+#define IRQ_VECTOR_BASE 32 // Same vectors the 8259 was remapped to
+
+static volatile uint32_t* lapic = 0;
+static int enabled = 0;
+static uint8_t bsp_id = 0;
+
+__attribute__((naked)) static void apic_spurious_stub(void) {
+    // Spurious interrupts must not be acknowledged
+    asm volatile("iret");
+}
+
+uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+void lapic_write(uint32_t reg, uint32_t val) {
+    lapic[reg / 4] = val;
+    (void)lapic[LAPIC_ID / 4]; // Read back to post the write
+}
+
+uint8_t lapic_id(void) {
+    return (uint8_t)(lapic_read(LAPIC_ID) >> 24);
+}
+
+void lapic_eoi(void) {
+    lapic[LAPIC_EOI / 4] = 0;
+}
+
+int apic_enabled(void) {
+    return enabled;
+}
+
+static uint32_t ioapic_read(uint32_t base, uint8_t reg) {
+    *(volatile uint32_t*)(base + IOAPIC_REGSEL) = reg;
+    return *(volatile uint32_t*)(base + IOAPIC_WIN);
+}
+
+static void ioapic_write(uint32_t base, uint8_t reg, uint32_t val) {
+    *(volatile uint32_t*)(base + IOAPIC_REGSEL) = reg;
+    *(volatile uint32_t*)(base + IOAPIC_WIN) = val;
+}
+
+// Finds the I/O APIC serving a GSI, returns its base and the pin on it
+static uint32_t ioapic_for_gsi(uint32_t gsi, uint32_t* pin) {
+    const acpi_madt_info_t* m = acpi_madt();
+
+    for (int i = 0; i < m->ioapic_count; i++) {
+        const acpi_ioapic_t* io = &m->ioapic[i];
+        uint32_t entries = ((ioapic_read(io->addr, IOAPIC_VER) >> 16) & 0xFF) + 1;
+
+        if (gsi >= io->gsi_base && gsi < io->gsi_base + entries) {
+            *pin = gsi - io->gsi_base;
+            return io->addr;
+        }
+    }
+
+    return 0;
+}
+
+// Routes an ISA IRQ to its usual vector on the boot CPU, left masked
+static void ioapic_route(uint8_t irq) {
+    const acpi_irq_override_t* o = &acpi_madt()->isa[irq];
+    uint32_t pin;
+    uint32_t base = ioapic_for_gsi(o->gsi, &pin);
+
+    if (!base)
+        return;
+
+    uint32_t lo = (IRQ_VECTOR_BASE + irq) | RED_MASKED;
+
+    if ((o->flags & INTI_POLARITY_MASK) == INTI_ACTIVE_LOW)
+        lo |= RED_ACTIVE_LOW;
+    if ((o->flags & INTI_TRIGGER_MASK) == INTI_LEVEL)
+        lo |= RED_LEVEL;
+
+    ioapic_write(base, (uint8_t)(IOAPIC_REDTBL + pin * 2 + 1), (uint32_t)bsp_id << 24);
+    ioapic_write(base, (uint8_t)(IOAPIC_REDTBL + pin * 2), lo);
+}
+
+void ioapic_set_mask(uint8_t irq, int masked) {
+    uint32_t pin;
+    uint32_t base = ioapic_for_gsi(acpi_madt()->isa[irq].gsi, &pin);
+
+    if (!base)
+        return;
+
+    uint8_t reg = (uint8_t)(IOAPIC_REDTBL + pin * 2);
+    uint32_t lo = ioapic_read(base, reg);
+
+    lo = masked ? (lo | RED_MASKED) : (lo & ~RED_MASKED);
+    ioapic_write(base, reg, lo);
+}
+
+int apic_init(void) {
+    uint32_t a, b, c, d;
+
+    cpuid(1, 0, &a, &b, &c, &d);
+    if (!(d & CPUID_EDX_APIC))
+        return -1;
+
+    if (acpi_parse_madt() != 0)
+        return -2;
+
+    const acpi_madt_info_t* m = acpi_madt();
+
+    lapic = (volatile uint32_t*)m->lapic_addr;
+    wrmsr(MSR_APIC_BASE, (rdmsr(MSR_APIC_BASE) & ~0xFFFu) | APIC_BASE_ENABLE);
+
+    idt_set_gate(APIC_SPURIOUS_VECTOR, (uint32_t)apic_spurious_stub, 0x08, 0x8E);
+    lapic_write(LAPIC_SVR, SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_TPR, 0);
+    bsp_id = lapic_id();
+
+    // IRQ2 is the 8259 cascade and never reaches the I/O APIC
+    for (uint8_t irq = 0; irq < 16; irq++)
+        if (irq != 2)
+            ioapic_route(irq);
+
+    // The 8259 stays remapped to 0x20 so a stray spurious IRQ can't land on an exception
+    outb(0x21, 0xFF);
+    outb(0xA1, 0xFF);
+
+    enabled = 1;
+
+    return 0;
+}
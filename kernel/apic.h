@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+
+// Local APIC registers (offsets from the MMIO base)
+#define LAPIC_ID     0x020
+#define LAPIC_TPR    0x080
+#define LAPIC_EOI    0x0B0
+#define LAPIC_SVR    0x0F0
+#define LAPIC_ESR    0x280
+#define LAPIC_ICR_LO 0x300
+#define LAPIC_ICR_HI 0x310
+
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+int apic_init(void);
+int apic_enabled(void);
+uint32_t lapic_read(uint32_t reg);
+void lapic_write(uint32_t reg, uint32_t val);
+uint8_t lapic_id(void);
+void lapic_eoi(void);
+void ioapic_set_mask(uint8_t irq, int masked);
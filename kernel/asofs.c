@@ -3,8 +3,13 @@
 #include "asofs.h"
 #include "disk.h"
 #include "console.h"
+#include "prof.h"
+#include "event.h"
+#include "keyboard.h"
+#include "mouse.h"
+#include "fpu.h"
 
-#define SUPERBLOCK_LBA 50
+#define SUPERBLOCK_LBA 1024 // Past the kernel image, see KERNEL_MAX_SECTORS
 static asofs_superblock_t sb;
 
 static int asofs_read_data(uint32_t start_lba, uint8_t* dest, uint32_t size) {
@@ -189,6 +194,11 @@ void asofs_run_app(const char* name) {
 
     console_write("[ASOFS] App loaded in memory. Starting...\n");
     console_clear();  // We doin't want trash from other apps
+    prof_set_app(name);
+    event_flush(); // Input meant for the previous app
+    kbd_flush_events();
+    mouse_flush_events();
+    fpu_reset_app();
     void (*entry)(void) = (void (*)(void))APP_BASE;  // 0x00300000
     entry();
 }
@@ -0,0 +1,46 @@
+#include "bga.h"
+#include "io.h"
+#include <stdint.h>
+
+static inline void bga_write(uint16_t index, uint16_t val) {
+    outw(BGA_PORT_INDEX, index);
+    outw(BGA_PORT_DATA, val);
+}
+
+static inline uint16_t bga_read(uint16_t index) {
+    outw(BGA_PORT_INDEX, index);
+    return inw(BGA_PORT_DATA);
+}
+
+int bga_detect(void) {
+    uint16_t id = bga_read(BGA_INDEX_ID);
+
+    return id >= BGA_ID_MIN && id <= BGA_ID_MAX;
+}
+
+// The VBE BIOS already put the card in this mode; redoing it through DISPI
+// only adds the virtual height. NOCLEARMEM keeps the boot screen intact.
+int bga_set_mode(uint16_t w, uint16_t h, int pages) {
+    uint16_t vh = (uint16_t)(h * pages);
+
+    bga_write(BGA_INDEX_ENABLE, 0);
+    bga_write(BGA_INDEX_XRES, w);
+    bga_write(BGA_INDEX_YRES, h);
+    bga_write(BGA_INDEX_BPP, 32);
+    bga_write(BGA_INDEX_VIRT_WIDTH, w);
+    bga_write(BGA_INDEX_VIRT_HEIGHT, vh);
+    bga_write(BGA_INDEX_X_OFFSET, 0);
+    bga_write(BGA_INDEX_Y_OFFSET, 0);
+    bga_write(BGA_INDEX_ENABLE, BGA_ENABLED | BGA_LFB_ENABLED | BGA_NOCLEARMEM);
+
+    // Too little video memory shows up as a shorter virtual screen
+    if (bga_read(BGA_INDEX_XRES) != w || bga_read(BGA_INDEX_YRES) != h ||
+        bga_read(BGA_INDEX_VIRT_HEIGHT) < vh)
+        return -1;
+
+    return 0;
+}
+
+void bga_set_y_offset(uint16_t y) {
+    bga_write(BGA_INDEX_Y_OFFSET, y);
+}
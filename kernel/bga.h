@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+
+// Bochs Graphics Adapter (QEMU -vga std, Bochs, VirtualBox) DISPI interface
+#define BGA_PORT_INDEX 0x01CE
+#define BGA_PORT_DATA  0x01CF
+
+enum {
+    BGA_INDEX_ID = 0,
+    BGA_INDEX_XRES = 1,
+    BGA_INDEX_YRES = 2,
+    BGA_INDEX_BPP = 3,
+    BGA_INDEX_ENABLE = 4,
+    BGA_INDEX_BANK = 5,
+    BGA_INDEX_VIRT_WIDTH = 6,
+    BGA_INDEX_VIRT_HEIGHT = 7,
+    BGA_INDEX_X_OFFSET = 8,
+    BGA_INDEX_Y_OFFSET = 9,
+};
+
+#define BGA_ID_MIN 0xB0C0
+#define BGA_ID_MAX 0xB0C5
+
+#define BGA_ENABLED     0x01
+#define BGA_LFB_ENABLED 0x40
+#define BGA_NOCLEARMEM  0x80
+
+int bga_detect(void);
+// w x h at 32 bpp with room for 'pages' screens stacked vertically, 0 on success
+int bga_set_mode(uint16_t w, uint16_t h, int pages);
+// Scans out starting at line y of the virtual screen
+void bga_set_y_offset(uint16_t y);
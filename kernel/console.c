@@ -1,6 +1,7 @@
 #include "console.h"
 #include "gfx.h"
 #include "vga.h"
+#include "klog.h"
 #include "../ui/ui_gfx.h"
 #include "../lib/string.h"
 #include <stdint.h>
@@ -17,10 +18,54 @@ static uint32_t bg_col = 0x00000000;
 static int cursor_x = 0, cursor_y = 0;
 static int cols = 80, rows = 25;
 
-static char screen_buf[MAX_ROWS][MAX_COLS];
+typedef struct {
+    uint32_t fg, bg; // 0x00RRGGBB, what graphics mode draws
+    char ch;
+    uint8_t attr;    // VGA attribute, what text mode draws
+} con_cell_t;
+
+#define DIRTY_WORDS ((MAX_COLS + 31) / 32)
+
+// Ring of text rows: screen row y lives in slot (top + y) % rows, so
+// scrolling just advances top. A set dirty bit means the pixels of that cell
+// were painted over and no longer show it.
+static con_cell_t screen_buf[MAX_ROWS][MAX_COLS];
+static uint32_t dirty[MAX_ROWS][DIRTY_WORDS];
+static int top = 0;
+
+// Last grid pushed through console_blit, indexed y * cols + x, char in the
+// low byte. Cells drawn any other way are marked stale so the next blit
+// repaints them.
+#define BLIT_STALE 0xFFFF
+static uint16_t blit_prev[MAX_ROWS * MAX_COLS];
+static uint32_t blit_known = 0; // blit_prev[0, blit_known) is on screen
+
+// Text overlay for app blits: per ring slot, the glyphs that aren't blank
+// with their colour already native. Rebuilt only after the row's text changes.
+static gfx_glyph_t ov_glyphs[MAX_ROWS][MAX_COLS];
+static uint8_t ov_count[MAX_ROWS];
+static uint8_t ov_valid[MAX_ROWS];
 
 static inline int clamp(int v, int lo, int hi){ return v<lo?lo:(v>hi?hi:v); }
 
+static inline int slot(int y){
+    int r = top + y;
+    return r >= rows ? r - rows : r;
+}
+
+static inline con_cell_t* line(int y){
+    return screen_buf[slot(y)];
+}
+
+static inline int is_dirty(int x, int y){
+    return (dirty[slot(y)][x >> 5] >> (x & 31)) & 1;
+}
+
+static inline void blit_stale(int x, int y){
+    uint32_t i = (uint32_t)(y * cols + x);
+    if (i < blit_known) blit_prev[i] = BLIT_STALE;
+}
+
 // VGA 16-color palette -> 0x00RRGGBB
 static uint32_t pal[16] = {
     0x000000, 0xAA0000, 0x00AA00, 0xAAAA00,
@@ -37,19 +82,29 @@ static void compute_grid_from_gfx(void){
     rows = gi->h / CHAR_H; if (rows > MAX_ROWS) rows = MAX_ROWS;
 }
 
-static void redraw_all_gfx(void){
-    for (int y = 0; y < rows; ++y){
-        for (int x = 0; x < cols; ++x){
-            char c = screen_buf[y][x] ? screen_buf[y][x] : ' ';
-            ui_gfx_put_char(x, y, c, fg_col, bg_col);
-        }
-    }
+static void blank_row(con_cell_t* row){
+    for (int x = 0; x < MAX_COLS; ++x)
+        row[x] = (con_cell_t){ fg_col, bg_col, ' ', 0x0F };
+}
+
+// Stores the cell and paints it, which also makes it clean
+static void set_cell(int x, int y, char c, uint32_t fg, uint32_t bg, uint8_t attr){
+    line(y)[x] = (con_cell_t){ fg, bg, c, attr };
+    dirty[slot(y)][x >> 5] &= ~(1u << (x & 31));
+    ov_valid[slot(y)] = 0;
+
+    if (use_gfx) ui_gfx_put_char(x, y, c, fg, bg);
+    else         vga_putchar_at(x, y, c, attr);
 }
 
+// Cleared cells match the gfx_clear/vga_clear that follows, nothing to draw
 static void clear_buffers(void){
     for (int y = 0; y < MAX_ROWS; ++y)
-        for (int x = 0; x < MAX_COLS; ++x)
-            screen_buf[y][x] = ' ';
+        blank_row(screen_buf[y]);
+    memset(dirty, 0, sizeof(dirty));
+    memset(ov_valid, 0, sizeof(ov_valid));
+    top = 0;
+    blit_known = 0;
     cursor_x = cursor_y = 0;
 }
 
@@ -60,7 +115,6 @@ void console_init(int use_gfx_mode) {
         compute_grid_from_gfx();
         clear_buffers();
         gfx_clear(bg_col);
-        redraw_all_gfx();
     } else {
         cols = 80; rows = 25;
         clear_buffers();
@@ -70,12 +124,8 @@ void console_init(int use_gfx_mode) {
 
 void console_clear(void) {
     clear_buffers();
-    if (use_gfx) {
-        gfx_clear(bg_col);
-        redraw_all_gfx();
-    } else {
-        vga_clear();
-    }
+    if (use_gfx) gfx_clear(bg_col);
+    else         vga_clear();
 }
 
 void console_setcolor(uint32_t fg, uint32_t bg) {
@@ -94,22 +144,21 @@ void console_setcursor(int x, int y){
     if (!use_gfx) vga_set_pos(cursor_x, cursor_y);
 }
 
+// The old top row is recycled as the new bottom one. On screen it's one
+// bulk move of the pixels or text cells, the new line starts out blank.
 static void scroll_up(void){
-    for (int y = 0; y < rows-1; ++y)
-        for (int x = 0; x < cols; ++x)
-            screen_buf[y][x] = screen_buf[y+1][x];
+    int fresh = slot(0);
 
-    for (int x = 0; x < cols; ++x)
-        screen_buf[rows-1][x] = ' ';
+    top = (top + 1 >= rows) ? 0 : top + 1;
+    blank_row(screen_buf[fresh]);
+    memset(dirty[fresh], 0, sizeof(dirty[fresh]));
+    ov_valid[fresh] = 0;
+    blit_known = 0;
 
-    if (use_gfx) {
-        redraw_all_gfx();
-    } else {
-        vga_clear();
-        for (int y = 0; y < rows; ++y)
-            for (int x = 0; x < cols; ++x)
-                vga_putchar_at(x, y, screen_buf[y][x], 0x0F);
-    }
+    if (use_gfx)
+        gfx_scroll_up(rows * CHAR_H, CHAR_H, bg_col);
+    else
+        vga_scroll_up();
 }
 
 void console_putchar(char c) {
@@ -123,13 +172,11 @@ void console_putchar(char c) {
             cursor_y--;
             cursor_x = cols - 1;
         }
-        screen_buf[cursor_y][cursor_x] = ' ';
-        if (use_gfx) ui_gfx_put_char(cursor_x, cursor_y, ' ', fg_col, bg_col);
-        else         vga_putchar_at(cursor_x, cursor_y, ' ', 0x0F);
+        blit_stale(cursor_x, cursor_y);
+        set_cell(cursor_x, cursor_y, ' ', fg_col, bg_col, 0x0F);
     } else {
-        screen_buf[cursor_y][cursor_x] = c;
-        if (use_gfx) ui_gfx_put_char(cursor_x, cursor_y, c, fg_col, bg_col);
-        else         vga_putchar_at(cursor_x, cursor_y, c, 0x0F);
+        blit_stale(cursor_x, cursor_y);
+        set_cell(cursor_x, cursor_y, c, fg_col, bg_col, 0x0F);
 
         cursor_x++;
         if (cursor_x >= cols) { cursor_x = 0; cursor_y++; }
@@ -148,57 +195,84 @@ void console_backspace(void){
 }
 
 void console_write(const char* s) {
+    klog(s); // Serial copy first, the glyph rendering below is the slow part
     for (; *s; ++s) console_putchar(*s);
+    if (use_gfx) gfx_flush();
 }
 
 void console_put_at(int x, int y, char c) {
     x = clamp(x, 0, cols-1);
     y = clamp(y, 0, rows-1);
-    screen_buf[y][x] = c;
+    blit_stale(x, y);
+    set_cell(x, y, c, fg_col, bg_col, 0x0F);
+}
 
-    if (use_gfx) ui_gfx_put_char(x, y, c, fg_col, bg_col);
-    else         vga_putchar_at(x, y, c, 0x0F);
+static void put_cell(int x, int y, char c, uint8_t attr) {
+    set_cell(x, y, c, pal[attr & 0x0F], pal[(attr >> 4) & 0x0F], attr);
 }
 
 void console_put_at_color(int x, int y, char c, uint8_t attr) {
     x = clamp(x, 0, cols-1);
     y = clamp(y, 0, rows-1);
-    screen_buf[y][x] = c;
+    blit_stale(x, y);
+    put_cell(x, y, c, attr);
+}
 
-    uint32_t fg = pal[attr & 0x0F];
-    uint32_t bg = pal[(attr >> 4) & 0x0F];
+// A row-major grid of {char, attr} cells from the top-left corner. Only
+// cells that differ from the previous grid or were painted over are drawn,
+// compared two at a time.
+uint32_t console_blit(const uint16_t* cells, uint32_t count) {
+    uint32_t max = (uint32_t)(cols * rows);
 
-    if (use_gfx)
-        ui_gfx_put_char(x, y, c, fg, bg);
-    else
-        vga_putchar_at(x, y, c, attr);
-}
+    if (count > max)
+        count = max;
 
-void console_redraw(void) {
-    if (!use_gfx) {
-        vga_clear();
+    for (uint32_t i = 0; i < count; i += 2) {
+        int x = (int)(i % (uint32_t)cols), y = (int)(i / (uint32_t)cols);
 
-        for (int y = 0; y < rows; y++) {
-            for (int x = 0; x < cols; x++) {
-                vga_putchar_at(x, y, screen_buf[y][x], 0x0F);
-            }
+        // cols is even in every mode we set, so a pair never straddles rows
+        if (i + 2 <= blit_known && i + 2 <= count &&
+            *(const uint32_t*)&cells[i] == *(const uint32_t*)&blit_prev[i] &&
+            !((dirty[slot(y)][x >> 5] >> (x & 31)) & 3))
+            continue;
+
+        for (uint32_t j = i; j < i + 2 && j < count; j++) {
+            x = (int)(j % (uint32_t)cols);
+            y = (int)(j / (uint32_t)cols);
+            if (j < blit_known && cells[j] == blit_prev[j] && !is_dirty(x, y))
+                continue;
+
+            blit_prev[j] = cells[j];
+            put_cell(x, y, (char)(cells[j] & 0xFF), (uint8_t)(cells[j] >> 8));
         }
-        vga_set_pos(cursor_x, cursor_y);
+    }
+
+    if (count > blit_known)
+        blit_known = count;
 
+    return count;
+}
+
+// Pixel rect (x, y, w, h) was painted over by something other than the console
+void console_damage(int x, int y, int w, int h) {
+    if (w <= 0 || h <= 0)
+        return;
+    // Wholly off the text grid: clamping would mark the edge cells instead
+    if (x + w <= 0 || y + h <= 0 || x >= cols * CHAR_W || y >= rows * CHAR_H)
         return;
-    }
 
-    for (int y = 0; y < rows; y++) {
-        for (int x = 0; x < cols; x++) {
-            char c = screen_buf[y][x];
+    int cx0 = clamp(x / CHAR_W, 0, cols - 1), cx1 = clamp((x + w - 1) / CHAR_W, 0, cols - 1);
+    int cy0 = clamp(y / CHAR_H, 0, rows - 1), cy1 = clamp((y + h - 1) / CHAR_H, 0, rows - 1);
 
-            if (!c || c == ' ')
-                continue;
-            gfx_draw_char_fg(x * CHAR_W, y * CHAR_H, c, fg_col);
-        }
+    for (int cy = cy0; cy <= cy1; cy++) {
+        uint32_t* d = dirty[slot(cy)];
+
+        for (int cx = cx0; cx <= cx1; cx++)
+            d[cx >> 5] |= 1u << (cx & 31);
     }
 }
 
+// Draws the row's glyphs in their own colours over whatever the app put below
 void console_overlay_row_fg(int row) {
     if (!use_gfx)
         return;
@@ -206,13 +280,22 @@ void console_overlay_row_fg(int row) {
     if (row < 0 || row >= rows)
         return;
 
-    int y0 = row * CHAR_H;
+    int sl = slot(row);
 
-    for (int x = 0; x < cols; x++) {
-        char c = screen_buf[row][x];
+    if (!ov_valid[sl]) {
+        con_cell_t* cells = screen_buf[sl];
+        int n = 0;
 
-        if (!c || c == ' ')
-            continue;
-        gfx_draw_char_fg(x * CHAR_W, y0, c, fg_col);
+        for (int x = 0; x < cols; x++) {
+            char c = cells[x].ch;
+
+            if (!c || c == ' ')
+                continue;
+            ov_glyphs[sl][n++] = (gfx_glyph_t){ (uint16_t)(x * CHAR_W), (uint8_t)c, 0, gfx_native(cells[x].fg) };
+        }
+        ov_count[sl] = (uint8_t)n;
+        ov_valid[sl] = 1;
     }
+
+    gfx_overlay_row(row * CHAR_H, ov_glyphs[sl], ov_count[sl]);
 }
@@ -16,5 +16,6 @@ void console_setcursor(int x, int y);
 void console_put_at_color(int x, int y, char c, uint8_t attr);
 void console_setcursor(int x, int y);
 void console_get_size(int* cols, int* rows);
-void console_redraw(void);
 void console_overlay_row_fg(int row);
+uint32_t console_blit(const uint16_t* cells, uint32_t count);
+void console_damage(int x, int y, int w, int h);
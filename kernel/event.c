@@ -0,0 +1,193 @@
+#include "event.h"
+#include "waitq.h"
+#include "keyboard.h"
+#include <stdint.h>
+
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+
+// A key press is both an event and a getchar character; kbd_seq names the
+// character so taking one can drop the other
+typedef struct {
+    event_t ev;
+    uint32_t kbd_seq; // KBD_NO_SEQ unless EV_KEY_DOWN put a character in the buffer
+} slot_t;
+
+// Producers are IRQ handlers and syscalls on the BSP, the consumer pops with
+// interrupts off, so plain indexes are enough
+static slot_t queue[EVENT_QUEUE_SIZE];
+static volatile uint32_t ev_head = 0;
+static volatile uint32_t ev_tail = 0;
+static volatile uint32_t ev_wanted = 0; // Mask of the latest event_wait
+static waitq_t ev_wait;
+
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    if (flags & 0x200)
+        asm volatile("sti" : : : "memory");
+}
+
+// Takes slot i out of the queue, the older slots move up one to fill it.
+// Interrupts must be off.
+static void unlink(uint32_t i) {
+    for (; i != ev_head; i--)
+        queue[i & EVENT_QUEUE_MASK] = queue[(i - 1) & EVENT_QUEUE_MASK];
+    ev_head++;
+}
+
+static void post(uint16_t type, uint16_t code, int x, int y, uint32_t data, uint32_t kbd_seq) {
+    uint32_t flags = irq_save();
+
+    // A burst of motion only matters for where it ended up, fold it into the
+    // newest queued move instead of flooding the queue
+    if (type == EV_MOUSE_MOVE && ev_tail != ev_head) {
+        event_t* last = &queue[(ev_tail - 1) & EVENT_QUEUE_MASK].ev;
+
+        if (last->type == EV_MOUSE_MOVE) {
+            last->x = (int16_t)x;
+            last->y = (int16_t)y;
+            last->data = data;
+            last->ticks = g_ticks;
+            irq_restore(flags);
+            waitq_wake(&ev_wait);
+            return;
+        }
+    }
+
+    // Full: evict the oldest event the app isn't waiting for (key releases
+    // and mouse clicks for a keys-only app pile up otherwise), else drop the
+    // newest. Either way a key's character stays with getchar.
+    if (ev_tail - ev_head == EVENT_QUEUE_SIZE) {
+        for (uint32_t i = ev_head; i != ev_tail; i++) {
+            if (!(ev_wanted & (1u << queue[i & EVENT_QUEUE_MASK].ev.type))) {
+                unlink(i);
+                break;
+            }
+        }
+    }
+
+    if (ev_tail - ev_head < EVENT_QUEUE_SIZE) {
+        event_t* e = &queue[ev_tail & EVENT_QUEUE_MASK].ev;
+
+        e->type = type;
+        e->code = code;
+        e->x = (int16_t)x;
+        e->y = (int16_t)y;
+        e->data = data;
+        e->ticks = g_ticks;
+        queue[ev_tail & EVENT_QUEUE_MASK].kbd_seq = kbd_seq;
+        ev_tail++;
+    }
+
+    irq_restore(flags);
+    waitq_wake(&ev_wait);
+}
+
+void event_post(uint16_t type, uint16_t code, int x, int y, uint32_t data) {
+    post(type, code, x, y, data, KBD_NO_SEQ);
+}
+
+// kbd_seq: the character kbd_push returned for this press, or KBD_NO_SEQ
+void event_post_key(uint16_t type, uint16_t code, uint32_t data, uint32_t kbd_seq) {
+    post(type, code, 0, 0, data, kbd_seq);
+}
+
+// Removes the oldest event matching mask. Events outside the mask stay
+// queued for a later wait, or until the queue fills up.
+static int event_pop(uint32_t mask, event_t* out, uint32_t* kbd_seq) {
+    uint32_t flags = irq_save();
+    int found = 0;
+
+    for (uint32_t i = ev_head; i != ev_tail; i++) {
+        const slot_t* s = &queue[i & EVENT_QUEUE_MASK];
+
+        if (!(mask & (1u << s->ev.type)))
+            continue;
+
+        *out = s->ev;
+        *kbd_seq = s->kbd_seq;
+        unlink(i);
+        found = 1;
+        break;
+    }
+
+    irq_restore(flags);
+    return found;
+}
+
+// Blocks until an event in mask arrives or timeout ticks pass (0 = just poll).
+// Returns the event type, EV_TIMER on timeout if asked for, otherwise EV_NONE.
+int event_wait(uint32_t mask, uint32_t timeout, event_t* out) {
+    uint32_t deadline = g_ticks + timeout;
+    int forever = (timeout == EV_WAIT_FOREVER);
+
+    ev_wanted = mask;
+
+    for (;;) {
+        uint32_t seen = waitq_seq(&ev_wait);
+
+        uint32_t kbd_seq;
+
+        if (event_pop(mask, out, &kbd_seq)) {
+            // Keys also fed the getchar buffer, keep the two in step
+            kbd_discard(kbd_seq);
+            return out->type;
+        }
+
+        if (timeout == 0 || waitq_sleep(&ev_wait, seen, deadline, forever) < 0)
+            break;
+    }
+
+    out->type = EV_NONE;
+    out->code = 0;
+    out->x = out->y = 0;
+    out->data = g_ticks;
+    out->ticks = g_ticks;
+
+    if (mask & EVM_TIMER) {
+        out->type = EV_TIMER;
+        return EV_TIMER;
+    }
+
+    return EV_NONE;
+}
+
+// Drops every queued event, and with them the characters of the key presses
+void event_flush(void) {
+    uint32_t flags = irq_save();
+
+    ev_wanted = 0; // The next app hasn't asked for anything yet
+
+    while (ev_head != ev_tail) {
+        uint32_t seq = queue[ev_head & EVENT_QUEUE_MASK].kbd_seq;
+
+        ev_head++;
+        kbd_discard(seq); // Nests its own cli, IF stays off
+    }
+
+    irq_restore(flags);
+}
+
+// Boot-time check: an app waiting on key presses alone takes each one as it
+// arrives and leaves the release queued. It must keep getting presses well
+// past EVENT_QUEUE_SIZE of those. Returns 0 if it does.
+int event_selfcheck(void) {
+    int bad = 0;
+    event_t e;
+
+    event_flush();
+    for (int i = 0; i < 4 * EVENT_QUEUE_SIZE; i++) {
+        post(EV_KEY_DOWN, (uint16_t)i, 0, 0, 0, KBD_NO_SEQ);
+        if (event_wait(1u << EV_KEY_DOWN, 0, &e) != EV_KEY_DOWN || e.code != (uint16_t)i)
+            bad = 1;
+        post(EV_KEY_UP, (uint16_t)i, 0, 0, 0, KBD_NO_SEQ);
+    }
+    event_flush();
+
+    return bad ? -1 : 0;
+}
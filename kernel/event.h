@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+
+#define EVENT_QUEUE_SIZE 128 // Power of two
+
+// Event types, the wait mask is a bit per type (1 << type)
+enum {
+    EV_NONE = 0,
+    EV_KEY_DOWN = 1,    // code = scancode (0xE0xx extended), data = character or KEY_*
+    EV_KEY_UP = 2,
+    EV_MOUSE_MOVE = 3,  // x, y = position, data = buttons
+    EV_MOUSE_BUTTON = 4,
+    EV_TIMER = 5,       // Timeout expired, data = g_ticks
+    EV_IO = 6,          // Submission ring posted completions, code = syscall, data = count
+    EV_MOUSE_WHEEL = 7, // data = signed notches
+};
+
+#define EVM_KEY    ((1u << EV_KEY_DOWN) | (1u << EV_KEY_UP))
+#define EVM_MOUSE  ((1u << EV_MOUSE_MOVE) | (1u << EV_MOUSE_BUTTON) | (1u << EV_MOUSE_WHEEL))
+#define EVM_TIMER  (1u << EV_TIMER)
+#define EVM_IO     (1u << EV_IO)
+#define EVM_ALL    0xFFFFFFFFu
+
+#define EV_WAIT_FOREVER 0xFFFFFFFFu
+
+typedef struct {
+    uint16_t type;
+    uint16_t code;
+    int16_t x, y;
+    uint32_t data;
+    uint32_t ticks; // When it was posted
+} event_t;
+
+void event_post(uint16_t type, uint16_t code, int x, int y, uint32_t data);
+void event_post_key(uint16_t type, uint16_t code, uint32_t data, uint32_t kbd_seq);
+int event_wait(uint32_t mask, uint32_t timeout, event_t* out);
+void event_flush(void);
+int event_selfcheck(void);
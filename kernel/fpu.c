@@ -0,0 +1,203 @@
+#include "fpu.h"
+#include "cpu.h"
+#include "smp.h"
+#include "console.h"
+#include <stdint.h>
+
+#define CR0_MP (1u << 1)
+#define CR0_EM (1u << 2)
+#define CR0_TS (1u << 3)
+#define CR0_NE (1u << 5)
+#define CR4_OSFXSR (1u << 9)
+#define CR4_OSXMMEXCPT (1u << 10)
+#define CR4_OSXSAVE (1u << 18)
+
+#define XCR0_X87 (1u << 0)
+#define XCR0_SSE (1u << 1)
+#define XCR0_AVX (1u << 2)
+
+#define MXCSR_DEFAULT 0x1F80 // All exceptions masked, round to nearest
+
+typedef struct {
+    uint8_t data[FPU_AREA_SIZE];
+} __attribute__((aligned(64))) fpu_area_t;
+
+// Only one app runs at a time, so it gets the single lazily switched context.
+// Kernel sections that interrupt another kernel section stash theirs per CPU.
+static fpu_area_t app_area;
+static volatile int app_saved = 0; // app_area holds state to restore on #NM
+static fpu_area_t nest_area[SMP_MAX_CPUS][FPU_NEST_MAX];
+
+static uint32_t features = 0;
+static uint32_t xcr0 = 0;
+static uint32_t area_size = 108; // fnsave image
+
+static inline void clts(void) {
+    asm volatile("clts");
+}
+
+static inline void stts(void) {
+    uint32_t cr0;
+
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    asm volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_TS));
+}
+
+static void fpu_save(fpu_area_t* a) {
+    if (features & FPU_F_XSAVE)
+        asm volatile("xsave (%0)" : : "r"(a->data), "a"(xcr0), "d"(0) : "memory");
+    else if (features & FPU_F_SSE)
+        asm volatile("fxsave (%0)" : : "r"(a->data) : "memory");
+    else
+        asm volatile("fnsave (%0); fwait" : : "r"(a->data) : "memory");
+}
+
+static void fpu_restore(fpu_area_t* a) {
+    if (features & FPU_F_XSAVE)
+        asm volatile("xrstor (%0)" : : "r"(a->data), "a"(xcr0), "d"(0) : "memory");
+    else if (features & FPU_F_SSE)
+        asm volatile("fxrstor (%0)" : : "r"(a->data) : "memory");
+    else
+        asm volatile("frstor (%0)" : : "r"(a->data) : "memory");
+}
+
+static void fpu_fresh(void) {
+    uint32_t mxcsr = MXCSR_DEFAULT;
+
+    asm volatile("fninit");
+    if (features & FPU_F_SSE)
+        asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+}
+
+// CR0/CR4/XCR0 are per CPU, every AP runs this too
+void fpu_init_cpu(void) {
+    uint32_t cr0, cr4;
+
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE;
+    asm volatile("mov %0, %%cr0" : : "r"(cr0));
+
+    if (features & FPU_F_SSE) {
+        asm volatile("mov %%cr4, %0" : "=r"(cr4));
+        cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+        if (features & FPU_F_XSAVE)
+            cr4 |= CR4_OSXSAVE;
+        asm volatile("mov %0, %%cr4" : : "r"(cr4));
+    }
+
+    if (features & FPU_F_XSAVE)
+        asm volatile("xsetbv" : : "c"(0), "a"(xcr0), "d"(0));
+
+    fpu_fresh();
+}
+
+void fpu_init(void) {
+    uint32_t a, b, c, d;
+
+    cpuid(1, 0, &a, &b, &c, &d);
+
+    if ((d & (1u << 24)) && (d & (1u << 25))) { // FXSR, SSE
+        features |= FPU_F_SSE;
+        area_size = 512;
+    }
+
+    if ((features & FPU_F_SSE) && (c & (1u << 26))) { // XSAVE
+        features |= FPU_F_XSAVE;
+        xcr0 = XCR0_X87 | XCR0_SSE;
+        if (c & (1u << 28)) { // AVX
+            features |= FPU_F_AVX;
+            xcr0 |= XCR0_AVX;
+        }
+    }
+
+    fpu_init_cpu();
+
+    if (features & FPU_F_XSAVE) {
+        cpuid(0xD, 0, &a, &b, &c, &d); // EBX: image size for the bits now in XCR0
+        if (b > FPU_AREA_SIZE) {
+            console_write("[FPU] XSAVE area too large, AVX disabled\n");
+            features &= ~FPU_F_AVX;
+            xcr0 &= ~XCR0_AVX;
+            asm volatile("xsetbv" : : "c"(0), "a"(xcr0), "d"(0));
+            cpuid(0xD, 0, &a, &b, &c, &d);
+        }
+        area_size = b;
+    }
+}
+
+uint32_t fpu_features(void) {
+    return features;
+}
+
+uint32_t fpu_area_size(void) {
+    return area_size;
+}
+
+void kernel_fpu_begin(void) {
+    uint32_t flags;
+
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+
+    percpu_t* c = smp_this_cpu();
+    int depth = c->fpu_depth++;
+
+    if (depth > FPU_NEST_MAX) {
+        console_write("[FPU] kernel sections nested too deep\n");
+        for (;;) asm volatile("hlt");
+    }
+
+    clts();
+    if (depth > 0) {
+        fpu_save(&nest_area[c->index][depth - 1]);
+    } else if (c->fpu_app_live) {
+        fpu_save(&app_area);
+        app_saved = 1;
+        c->fpu_app_live = 0;
+    }
+
+    asm volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+void kernel_fpu_end(void) {
+    uint32_t flags;
+
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+
+    percpu_t* c = smp_this_cpu();
+    int depth = --c->fpu_depth;
+
+    if (depth > 0)
+        fpu_restore(&nest_area[c->index][depth - 1]);
+    else
+        stts(); // The app gets its registers back on its next FPU instruction
+
+    asm volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+// #NM: an FPU instruction ran with CR0.TS set. Outside a kernel section that
+// can only be the app, so hand it back its registers.
+int fpu_handle_nm(void) {
+    percpu_t* c = smp_this_cpu();
+
+    if (c->fpu_depth)
+        return -1;
+
+    clts();
+    if (app_saved)
+        fpu_restore(&app_area);
+    else
+        fpu_fresh();
+    c->fpu_app_live = 1;
+
+    return 0;
+}
+
+void fpu_reset_app(void) {
+    uint32_t flags;
+
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    app_saved = 0;
+    smp_this_cpu()->fpu_app_live = 0;
+    stts();
+    asm volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+
+// What the OS switched on, see fpu_features
+#define FPU_F_SSE   (1u << 0) // FXSAVE + SSE state, CR4.OSFXSR
+#define FPU_F_XSAVE (1u << 1) // XSAVE/XRSTOR and XCR0
+#define FPU_F_AVX   (1u << 2) // YMM upper halves enabled in XCR0
+
+#define FPU_AREA_SIZE 1024 // x87 + SSE + AVX XSAVE image is 832 bytes
+#define FPU_NEST_MAX 4     // Kernel sections interrupted by another kernel section
+
+void fpu_init(void);
+void fpu_init_cpu(void);
+uint32_t fpu_features(void);
+uint32_t fpu_area_size(void);
+
+// Brackets kernel code that touches x87/SSE/AVX registers. The app's state is
+// saved on the first use and comes back lazily through #NM once it runs again.
+// Safe to nest from interrupt handlers.
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+// Called from isr_handler for vector 7, 0 if the fault was ours to handle
+int fpu_handle_nm(void);
+// New app, new register state
+void fpu_reset_app(void);
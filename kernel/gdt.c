@@ -0,0 +1,52 @@
+#include "gdt.h"
+#include "smp.h"
+#include "../lib/string.h"
+#include <stdint.h>
+
+#define GDT_ENTRIES 4
+
+static gdt_entry_t gdt[SMP_MAX_CPUS][GDT_ENTRIES];
+static gdt_ptr_t gdt_ptr[SMP_MAX_CPUS];
+static tss_t tss[SMP_MAX_CPUS];
+
+static void gdt_set(gdt_entry_t* e, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
+    e->limit_low = limit & 0xFFFF;
+    e->base_low = base & 0xFFFF;
+    e->base_mid = (base >> 16) & 0xFF;
+    e->access = access;
+    e->gran = (uint8_t)(((limit >> 16) & 0x0F) | (gran & 0xF0));
+    e->base_high = (base >> 24) & 0xFF;
+}
+
+// Builds and loads this CPU's GDT and TSS, then reloads every segment register
+void gdt_install_cpu(int cpu, uint32_t stack_top) {
+    gdt_entry_t* g = gdt[cpu];
+    tss_t* t = &tss[cpu];
+
+    memset(t, 0, sizeof(*t));
+    t->ss0 = GDT_KDATA;
+    t->esp0 = stack_top;
+    t->iomap_base = sizeof(tss_t); // No I/O bitmap
+
+    gdt_set(&g[0], 0, 0, 0, 0);
+    gdt_set(&g[1], 0, 0xFFFFF, 0x9A, 0xCF); // Code: ring 0, 4 GiB
+    gdt_set(&g[2], 0, 0xFFFFF, 0x92, 0xCF); // Data: ring 0, 4 GiB
+    gdt_set(&g[3], (uint32_t)t, sizeof(tss_t) - 1, 0x89, 0x00); // 32-bit TSS, available
+
+    gdt_ptr[cpu].limit = sizeof(gdt[cpu]) - 1;
+    gdt_ptr[cpu].base = (uint32_t)g;
+
+    asm volatile(
+        "lgdt %0\n"
+        "ljmp %1, $1f\n"
+        "1:\n"
+        "mov %2, %%ax\n"
+        "mov %%ax, %%ds\n"
+        "mov %%ax, %%es\n"
+        "mov %%ax, %%fs\n"
+        "mov %%ax, %%gs\n"
+        "mov %%ax, %%ss\n"
+        "mov %3, %%ax\n"
+        "ltr %%ax\n"
+        : : "m"(gdt_ptr[cpu]), "i"(GDT_KCODE), "i"(GDT_KDATA), "i"(GDT_TSS) : "eax", "memory");
+}
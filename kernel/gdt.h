@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+
+// Selectors, identical to the bootloader's flat GDT plus a per-CPU TSS
+#define GDT_KCODE 0x08
+#define GDT_KDATA 0x10
+#define GDT_TSS   0x18
+
+typedef struct {
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t base_mid;
+    uint8_t access;
+    uint8_t gran;
+    uint8_t base_high;
+} __attribute__((packed)) gdt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) gdt_ptr_t;
+
+typedef struct {
+    uint32_t prev_tss;
+    uint32_t esp0, ss0;
+    uint32_t esp1, ss1;
+    uint32_t esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap, iomap_base;
+} __attribute__((packed)) tss_t;
+
+void gdt_install_cpu(int cpu, uint32_t stack_top);
@@ -1,4 +1,9 @@
 #include "gfx.h"
+#include "bga.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "simd.h"
+#include "fpu.h"
 
 #include "../lib/string.h"
 
@@ -12,11 +17,65 @@
 #define OFF_XResolution 0x12          // uint16_t
 #define OFF_YResolution 0x14          // uint16_t
 #define OFF_BitsPerPixel 0x19         // uint8_t
+#define OFF_RedMaskSize 0x1F          // uint8_t, then position, green, blue, reserved
 #define OFF_PhysBasePtr 0x28          // uint32_t
 #define OFF_LinBytesPerScanLine 0x58  // uint32_t
 
+// RAM copy of the screen (BGRX, pitch = w*4). Primitives only draw here and
+// record what they touched; gfx_flush streams the dirty parts to the LFB.
+#define SHADOW_ADDR 0x00800000
+#define SHADOW_MAX  0x00800000 // 8 MiB, enough for 1920x1080x32
+
+#define DIRTY_MAX 32
+#define FLUSH_PARALLEL_ROWS 64 // Taller rects are split across CPUs
+
+typedef struct {
+    int x0, y0, x1, y1; // Exclusive right/bottom
+} rect_t;
+
+// Cursor plane: the sprite as per-row runs of opaque pixels
+#define CURSOR_MAX_H 32
+#define CURSOR_MAX_SPANS 96
+
+typedef struct {
+    uint8_t dx, len;
+} span_t;
+
+static struct {
+    int x, y;
+    int w, h;
+    int visible;
+    uint32_t bgr;
+    uint8_t first[CURSOR_MAX_H + 1]; // spans[first[row] .. first[row + 1])
+    span_t spans[CURSOR_MAX_SPANS];
+} cur;
+
 static gfx_info_t G;
 static uint8_t* LFB; // Linear Frame Buffer
+static uint32_t* SHADOW;
+static int gfx_ready = 0;
+
+static rect_t dirty[DIRTY_MAX];
+static int dirty_count = 0;
+static spinlock_t dirty_lock = SPINLOCK_INIT;
+static volatile int flushing = 0;
+
+// BGA double buffering: the LFB holds two pages, flushes go to the one not on
+// screen and a Y offset write flips them. That page missed the previous
+// flush too, so it gets both flushes' rects.
+static int flipping = 0;
+static int back_y = 0; // First line of the hidden page
+static rect_t prev[DIRTY_MAX];
+static int prev_count = 0;
+
+// Shapes, text and window blits draw only inside this. It's the whole screen
+// except while a command buffer has pushed a narrower one.
+static rect_t clip;
+
+// Font rows pre-expanded to pixels: glyph_mask[bits][i] is all ones where
+// pixel i of an 8-wide row is set, so a glyph row is 8 and/xor stores
+#define GLYPH_SIMD_MIN 4 // Shorter runs don't pay for kernel_fpu_begin
+static uint32_t glyph_mask[256][8] __attribute__((aligned(32)));
 
 static inline uint16_t rd16(const uint8_t* p) {
     return *(const uint16_t*)p;
@@ -43,43 +102,378 @@ int gfx_init(void) {
     G.pitch = (linPitch != 0) ? (uint16_t)linPitch : pitch;
     G.fb = phys;
 
+    G.r_size = m[OFF_RedMaskSize];
+    G.r_pos = m[OFF_RedMaskSize + 1];
+    G.g_size = m[OFF_RedMaskSize + 2];
+    G.g_pos = m[OFF_RedMaskSize + 3];
+    G.b_size = m[OFF_RedMaskSize + 4];
+    G.b_pos = m[OFF_RedMaskSize + 5];
+
+    if (!G.r_size || !G.g_size || !G.b_size) {
+        // VBE 1.x leaves the masks empty, keep the layout we always assumed
+        G.r_size = G.g_size = G.b_size = 8;
+        G.r_pos = 0;
+        G.g_pos = 8;
+        G.b_pos = 16;
+    }
+
+    if (G.r_size > 8) G.r_size = 8;
+    if (G.g_size > 8) G.g_size = 8;
+    if (G.b_size > 8) G.b_size = 8;
+
+    if (G.r_size == 8 && G.g_size == 8 && G.b_size == 8 && G.g_pos == 8) {
+        if (G.r_pos == 16 && G.b_pos == 0)
+            G.format = GFX_FMT_XRGB;
+        else if (G.r_pos == 0 && G.b_pos == 16)
+            G.format = GFX_FMT_XBGR;
+        else
+            G.format = GFX_FMT_OTHER;
+    } else {
+        G.format = GFX_FMT_OTHER;
+    }
+
     LFB = (uint8_t*)G.fb;
+    SHADOW = (uint32_t*)SHADOW_ADDR;
 
     if (G.bpp != 32) {
         // Can fallback of convert, for now we throw a error
         return -1;
     }
+    if ((uint32_t)G.w * G.h * 4 > SHADOW_MAX)
+        return -1;
+
+    if (bga_detect()) {
+        if (bga_set_mode(G.w, G.h, 2) == 0) {
+            flipping = 1;
+            back_y = G.h;
+            G.pitch = (uint16_t)(G.w * 4);
+            // Nothing valid on the second page yet
+            prev[0] = (rect_t){ 0, 0, G.w, G.h };
+            prev_count = 1;
+        } else {
+            bga_set_mode(G.w, G.h, 1);
+        }
+    }
+
+    clip = (rect_t){ 0, 0, G.w, G.h };
+
+    for (int b = 0; b < 256; b++)
+        for (int i = 0; i < 8; i++)
+            glyph_mask[b][i] = (b & (0x80 >> i)) ? 0xFFFFFFFFu : 0;
+
+    gfx_ready = 1;
     return 0;
 }
 
+int gfx_page_flipping(void) {
+    return flipping;
+}
+
+static inline uint32_t* lfb_row(int y) {
+    return (uint32_t*)(LFB + (size_t)(y + back_y) * G.pitch);
+}
+
+static inline uint32_t* shadow_row(int y) {
+    return SHADOW + (size_t)y * G.w;
+}
+
+// 0x00RRGGBB -> framebuffer order
+static inline uint32_t to_native(uint32_t rgb) {
+    if (G.format == GFX_FMT_XRGB)
+        return rgb;
+    if (G.format == GFX_FMT_XBGR)
+        return ((rgb & 0x000000FF) << 16) | (rgb & 0x0000FF00) | ((rgb & 0x00FF0000) >> 16);
+
+    return ((((rgb >> 16) & 0xFF) >> (8 - G.r_size)) << G.r_pos) |
+           ((((rgb >> 8) & 0xFF) >> (8 - G.g_size)) << G.g_pos) |
+           (((rgb & 0xFF) >> (8 - G.b_size)) << G.b_pos);
+}
+
+static inline uint32_t from_native(uint32_t px) {
+    if (G.format == GFX_FMT_XRGB)
+        return px & 0x00FFFFFF;
+    if (G.format == GFX_FMT_XBGR)
+        return ((px & 0x000000FF) << 16) | (px & 0x0000FF00) | ((px & 0x00FF0000) >> 16);
+
+    uint32_t r = ((px >> G.r_pos) & ((1u << G.r_size) - 1)) << (8 - G.r_size);
+    uint32_t g = ((px >> G.g_pos) & ((1u << G.g_size) - 1)) << (8 - G.g_size);
+    uint32_t b = ((px >> G.b_pos) & ((1u << G.b_size) - 1)) << (8 - G.b_size);
+    return (r << 16) | (g << 8) | b;
+}
+
+// n app pixels into the shadow; native sources are already in framebuffer order
+static void convert_run(uint32_t* dst, const uint32_t* src, size_t n, int native) {
+    if (native || G.format == GFX_FMT_XRGB) {
+        memcpy(dst, src, n * 4);
+        return;
+    }
+    if (G.format == GFX_FMT_XBGR) {
+        simd_rgb_to_bgrx(dst, src, n);
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++)
+        dst[i] = to_native(src[i]);
+}
+
+static inline int rects_touch(const rect_t* a, const rect_t* b) {
+    return a->x0 <= b->x1 && b->x0 <= a->x1 && a->y0 <= b->y1 && b->y0 <= a->y1;
+}
+
+static inline void rect_union(rect_t* a, const rect_t* b) {
+    if (b->x0 < a->x0) a->x0 = b->x0;
+    if (b->y0 < a->y0) a->y0 = b->y0;
+    if (b->x1 > a->x1) a->x1 = b->x1;
+    if (b->y1 > a->y1) a->y1 = b->y1;
+}
+
+// Call after the pixels are in the shadow, so a flush can never miss them
+void gfx_mark_dirty(int x, int y, int w, int h) {
+    rect_t r = { x, y, x + w, y + h };
+
+    if (r.x0 < 0) r.x0 = 0;
+    if (r.y0 < 0) r.y0 = 0;
+    if (r.x1 > G.w) r.x1 = G.w;
+    if (r.y1 > G.h) r.y1 = G.h;
+    if (r.x0 >= r.x1 || r.y0 >= r.y1)
+        return;
+
+    uint32_t flags = spin_lock_irqsave(&dirty_lock);
+
+    // Overlapping or adjacent rects (a run of glyphs, row bands) fold together
+    int i;
+    for (i = 0; i < dirty_count; i++) {
+        if (rects_touch(&dirty[i], &r)) {
+            rect_union(&dirty[i], &r);
+            break;
+        }
+    }
+
+    if (i == dirty_count) {
+        if (dirty_count < DIRTY_MAX) {
+            dirty[dirty_count++] = r;
+        } else {
+            // Out of slots: one bounding box is still cheaper than tracking more
+            for (i = 1; i < dirty_count; i++)
+                rect_union(&dirty[0], &dirty[i]);
+            rect_union(&dirty[0], &r);
+            dirty_count = 1;
+        }
+    }
+
+    spin_unlock_irqrestore(&dirty_lock, flags);
+}
+
+// Cursor plane, drawn straight into the LFB on top of whatever gets flushed
+static void cursor_paint(int y0, int y1) {
+    if (!cur.visible)
+        return;
+
+    if (y0 < cur.y)
+        y0 = cur.y;
+    if (y1 > cur.y + cur.h)
+        y1 = cur.y + cur.h;
+    if (y0 < 0)
+        y0 = 0;
+    if (y1 > G.h)
+        y1 = G.h;
+
+    for (int y = y0; y < y1; y++) {
+        int ry = y - cur.y;
+        uint32_t* dst = lfb_row(y);
+
+        for (int i = cur.first[ry]; i < cur.first[ry + 1]; i++) {
+            int x0 = cur.x + cur.spans[i].dx;
+            int x1 = x0 + cur.spans[i].len;
+
+            if (x0 < 0)
+                x0 = 0;
+            if (x1 > G.w)
+                x1 = G.w;
+
+            for (int x = x0; x < x1; x++)
+                dst[x] = cur.bgr;
+        }
+    }
+}
+
+static void flush_rows(void* arg, int y0, int y1) {
+    const rect_t* r = (const rect_t*)arg;
+    int w = r->x1 - r->x0;
+
+    y0 += r->y0;
+    y1 += r->y0;
+
+    // Whole rows and no padding: the block is contiguous on both sides
+    if (w == G.w && G.pitch == (uint32_t)G.w * 4) {
+        simd_copy_nt(lfb_row(y0), shadow_row(y0), (size_t)(y1 - y0) * G.w);
+        return;
+    }
+
+    for (int y = y0; y < y1; y++)
+        simd_copy_nt(lfb_row(y) + r->x0, shadow_row(y) + r->x0, (size_t)w);
+}
+
+// Unions made while marking can overlap rects that were added earlier
+static int coalesce(rect_t* r, int n) {
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) {
+            if (rects_touch(&r[i], &r[j])) {
+                rect_union(&r[i], &r[j]);
+                r[j] = r[--n];
+                j = i; // r[i] grew, recheck everything after it
+            }
+        }
+    }
+    return n;
+}
+
+// Streams every dirty rect to the LFB and composites the cursor on top. A
+// flush that interrupts another one leaves its rects for the next.
+void gfx_flush(void) {
+    rect_t todo[DIRTY_MAX * 2];
+    int n, fresh;
+
+    if (!gfx_ready || !dirty_count)
+        return;
+    if (__atomic_exchange_n(&flushing, 1, __ATOMIC_ACQUIRE))
+        return;
+
+    uint32_t flags = spin_lock_irqsave(&dirty_lock);
+    n = dirty_count;
+    memcpy(todo, dirty, (size_t)n * sizeof(rect_t));
+    dirty_count = 0;
+    spin_unlock_irqrestore(&dirty_lock, flags);
+
+    n = fresh = coalesce(todo, n);
+
+    if (flipping) {
+        memcpy(todo + n, prev, (size_t)prev_count * sizeof(rect_t));
+        memcpy(prev, todo, (size_t)fresh * sizeof(rect_t));
+        n = coalesce(todo, n + prev_count);
+        prev_count = fresh;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int rows = todo[i].y1 - todo[i].y0;
+
+        if (rows >= FLUSH_PARALLEL_ROWS)
+            sched_parallel_for(rows, 1, flush_rows, &todo[i]);
+        else
+            flush_rows(&todo[i], 0, rows);
+
+        cursor_paint(todo[i].y0, todo[i].y1);
+    }
+
+    if (flipping) {
+        bga_set_y_offset((uint16_t)back_y);
+        back_y = back_y ? 0 : G.h;
+    }
+
+    __atomic_store_n(&flushing, 0, __ATOMIC_RELEASE);
+}
+
+// mask is w*h bytes, non-zero = opaque
+void gfx_cursor_set_shape(const uint8_t* mask, int w, int h, uint32_t rgb) {
+    int n = 0;
+
+    gfx_mark_dirty(cur.x, cur.y, cur.w, cur.h);
+
+    if (w > 255)
+        w = 255;
+    if (h > CURSOR_MAX_H)
+        h = CURSOR_MAX_H;
+
+    for (int y = 0; y < h; y++) {
+        cur.first[y] = (uint8_t)n;
+
+        for (int x = 0; x < w && n < CURSOR_MAX_SPANS; ) {
+            if (!mask[y * w + x]) {
+                x++;
+                continue;
+            }
+
+            int start = x;
+            while (x < w && mask[y * w + x])
+                x++;
+
+            cur.spans[n].dx = (uint8_t)start;
+            cur.spans[n].len = (uint8_t)(x - start);
+            n++;
+        }
+    }
+    cur.first[h] = (uint8_t)n;
+    cur.w = w;
+    cur.h = h;
+    cur.bgr = to_native(rgb);
+
+    gfx_mark_dirty(cur.x, cur.y, cur.w, cur.h);
+    gfx_flush();
+}
+
+// The old spot is just refreshed from the shadow, the new one painted over it
+void gfx_cursor_move(int x, int y) {
+    if (x == cur.x && y == cur.y)
+        return;
+
+    gfx_mark_dirty(cur.x, cur.y, cur.w, cur.h);
+    cur.x = x;
+    cur.y = y;
+    gfx_mark_dirty(cur.x, cur.y, cur.w, cur.h);
+    gfx_flush();
+}
+
+void gfx_cursor_show(int visible) {
+    visible = visible ? 1 : 0;
+    if (visible == cur.visible)
+        return;
+
+    cur.visible = visible;
+    gfx_mark_dirty(cur.x, cur.y, cur.w, cur.h);
+    gfx_flush();
+}
+
 static inline void put32(int x, int y, uint32_t rgb)
 {
-    // rgb = 0x00RRGGBB -> mem = 0x00BBGGRR (BGRX in little-endian)
-    uint32_t bgr =
-        ((rgb & 0x000000FF) << 16) |   // B -> pos R
-        ( rgb & 0x0000FF00)        |   // G -> pos G
-        ((rgb & 0x00FF0000) >> 16);    // R -> pos B
+    shadow_row(y)[x] = to_native(rgb);
+}
+
+// n pixels of px, the string unit writes whole cache lines at a time
+static inline void fill32(uint32_t* dst, uint32_t px, size_t n) {
+    asm volatile("cld; rep stosl" : "+D"(dst), "+c"(n) : "a"(px) : "memory", "cc");
+}
 
-    *(uint32_t*)(LFB + (size_t)y * G.pitch + (size_t)x * 4) = bgr;
+static void clear_rows(void* arg, int y0, int y1) {
+    fill32(shadow_row(y0), *(const uint32_t*)arg, (size_t)(y1 - y0) * G.w);
 }
 
 void gfx_clear(uint32_t rgba) {
-    uint32_t bgr = ((rgba & 0x000000FF) << 16)
-                 |  (rgba & 0x0000FF00)
-                 | ((rgba & 0x00FF0000) >> 16);
+    uint32_t bgr = to_native(rgba);
 
-    for (int y = 0; y < G.h; y++) {
-        uint32_t* row = (uint32_t*)(LFB + (size_t)y * G.pitch);
+    sched_parallel_for(G.h, 1, clear_rows, &bgr);
+    gfx_mark_dirty(0, 0, G.w, G.h);
+}
 
-        for (int x = 0; x < G.w; x++)
-            row[x] = bgr;
-    }
+// Moves rows [dy, h) of the shadow up to the top and fills the dy rows left
+// behind with rgb
+void gfx_scroll_up(int h, int dy, uint32_t rgb) {
+    if (h > G.h)
+        h = G.h;
+    if (dy <= 0 || dy > h)
+        return;
+
+    memmove(shadow_row(0), shadow_row(dy), (size_t)(h - dy) * G.w * 4);
+
+    uint32_t px = to_native(rgb);
+    clear_rows(&px, h - dy, h);
+    gfx_mark_dirty(0, 0, G.w, h);
 }
 
 void gfx_putpixel(int x, int y, uint32_t rgba) {
-    if ((unsigned)x >= G.w || (unsigned)y >= G.h)
+    if (x < clip.x0 || x >= clip.x1 || y < clip.y0 || y >= clip.y1)
         return;
     put32(x, y, rgba);
+    gfx_mark_dirty(x, y, 1, 1);
 }
 
 void gfx_fillrect(int x, int y, int w, int h, uint32_t rgba) {
@@ -88,53 +482,202 @@ void gfx_fillrect(int x, int y, int w, int h, uint32_t rgba) {
 
     int x2 = x + w, y2 = y + h;
 
-    if (x < 0)
-        x = 0;
-    if (y < 0)
-        y = 0;
-    if (x2 > G.w)
-        x2 = G.w;
-    if (y2 > G.h)
-        y2 = G.h;
+    if (x < clip.x0)
+        x = clip.x0;
+    if (y < clip.y0)
+        y = clip.y0;
+    if (x2 > clip.x1)
+        x2 = clip.x1;
+    if (y2 > clip.y1)
+        y2 = clip.y1;
+    if (x >= x2 || y >= y2)
+        return;
 
-    for (int j = y; j < y2; ++j) {
-        uint32_t* row = (uint32_t*)(LFB + (size_t)j * G.pitch);
+    uint32_t px = to_native(rgba);
 
-        for (int i = x; i < x2; ++i)
-            row[i] = rgba;
+    if (x == 0 && x2 == G.w) {
+        fill32(shadow_row(y), px, (size_t)(y2 - y) * G.w);
+    } else {
+        for (int j = y; j < y2; ++j)
+            fill32(shadow_row(j) + x, px, (size_t)(x2 - x));
     }
+    gfx_mark_dirty(x, y, x2 - x, y2 - y);
 }
 
-void gfx_draw_char(int x, int y, char c, uint32_t fg, uint32_t bg) {
-    const uint8_t* g = FONT8x16_ADDR[(uint8_t)c];
+static inline int in_clip(int x, int y) {
+    return x >= clip.x0 && x < clip.x1 && y >= clip.y0 && y < clip.y1;
+}
+
+void gfx_hline(int x, int y, int w, uint32_t rgb) {
+    gfx_fillrect(x, y, w, 1, rgb);
+}
+
+void gfx_vline(int x, int y, int h, uint32_t rgb) {
+    gfx_fillrect(x, y, 1, h, rgb);
+}
 
-    for (int dy = 0; dy < 16; ++dy) {
-        uint8_t bits = g[dy];
+// Bresenham, end points included. Lines wholly on screen skip the per-pixel
+// clip test and walk a pointer through the shadow.
+void gfx_line(int x0, int y0, int x1, int y1, uint32_t rgb) {
+    if (y0 == y1) {
+        gfx_hline(x0 < x1 ? x0 : x1, y0, (x0 < x1 ? x1 - x0 : x0 - x1) + 1, rgb);
+        return;
+    }
+    if (x0 == x1) {
+        gfx_vline(x0, y0 < y1 ? y0 : y1, (y0 < y1 ? y1 - y0 : y0 - y1) + 1, rgb);
+        return;
+    }
 
-        for (int dx = 0; dx < 8; ++dx) {
-            uint32_t col = (bits & (0x80 >> dx)) ? fg : bg;
+    int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+    int dy = y1 > y0 ? y0 - y1 : y1 - y0; // Negative
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+    uint32_t px = to_native(rgb);
 
-            gfx_putpixel(x + dx, y + dy, col);
+    int bx = x0 < x1 ? x0 : x1, by = y0 < y1 ? y0 : y1;
+    int inside = in_clip(x0, y0) && in_clip(x1, y1);
+
+    if (inside) {
+        uint32_t* p = shadow_row(y0) + x0;
+        int step_y = sy * G.w;
+
+        for (;;) {
+            *p = px;
+            if (x0 == x1 && y0 == y1)
+                break;
+            int e2 = 2 * err;
+            if (e2 >= dy) { err += dy; x0 += sx; p += sx; }
+            if (e2 <= dx) { err += dx; y0 += sy; p += step_y; }
         }
+    } else {
+        for (;;) {
+            if (in_clip(x0, y0))
+                shadow_row(y0)[x0] = px;
+            if (x0 == x1 && y0 == y1)
+                break;
+            int e2 = 2 * err;
+            if (e2 >= dy) { err += dy; x0 += sx; }
+            if (e2 <= dx) { err += dx; y0 += sy; }
+        }
+    }
+    gfx_mark_dirty(bx, by, dx + 1, -dy + 1);
+}
+
+// Rows [r0, r1) and columns [c0, c1) of one glyph, fg/bg already native
+static void glyph_opaque(uint32_t* dst, const uint8_t* g, int c0, int c1, int r0, int r1,
+                         uint32_t fg, uint32_t bg) {
+    uint32_t diff = fg ^ bg;
+
+    dst += r0 * G.w;
+    for (int dy = r0; dy < r1; dy++, dst += G.w) {
+        const uint32_t* m = glyph_mask[g[dy]];
+
+        for (int i = c0; i < c1; i++)
+            dst[i] = bg ^ (diff & m[i]);
     }
 }
 
+// A run of whole glyphs on screen, each row two 16-byte stores. cols[] is
+// read with movdqa, so realign esp: kernel entry keeps whatever the app had.
+__attribute__((target("sse2"), force_align_arg_pointer))
+static void glyph_run_sse2(uint32_t* dst, const char* s, int n, uint32_t fg, uint32_t bg) {
+    uint32_t cols[8] __attribute__((aligned(16))) = {
+        fg ^ bg, fg ^ bg, fg ^ bg, fg ^ bg, bg, bg, bg, bg,
+    };
+    uint32_t pitch = (uint32_t)G.w * 4;
+
+    for (int i = 0; i < n; i++, dst += 8) {
+        uint32_t* d = dst;
+        const uint8_t* g = FONT8x16_ADDR[(uint8_t)s[i]];
+        int rows = 16;
+
+        asm volatile(
+            "movdqa (%3), %%xmm6\n"
+            "movdqa 16(%3), %%xmm7\n"
+            "1:\n"
+            "movzbl (%1), %%eax\n"
+            "shl $5, %%eax\n"
+            "movdqa (%4,%%eax), %%xmm0\n"
+            "movdqa 16(%4,%%eax), %%xmm1\n"
+            "pand %%xmm6, %%xmm0\n"
+            "pand %%xmm6, %%xmm1\n"
+            "pxor %%xmm7, %%xmm0\n"
+            "pxor %%xmm7, %%xmm1\n"
+            "movdqu %%xmm0, (%0)\n"
+            "movdqu %%xmm1, 16(%0)\n"
+            "add %5, %0\n"
+            "inc %1\n"
+            "decl %2\n"
+            "jnz 1b\n"
+            : "+r"(d), "+r"(g), "+m"(rows)
+            : "r"(cols), "r"(glyph_mask), "m"(pitch)
+            : "eax", "xmm0", "xmm1", "xmm6", "xmm7", "memory", "cc");
+    }
+}
+
+void gfx_draw_char(int x, int y, char c, uint32_t fg, uint32_t bg) {
+    int c0 = (x < clip.x0) ? clip.x0 - x : 0, c1 = (x + 8 > clip.x1) ? clip.x1 - x : 8;
+    int r0 = (y < clip.y0) ? clip.y0 - y : 0, r1 = (y + 16 > clip.y1) ? clip.y1 - y : 16;
+
+    if (c0 >= c1 || r0 >= r1)
+        return;
+
+    glyph_opaque(SHADOW + y * G.w + x, FONT8x16_ADDR[(uint8_t)c], c0, c1, r0, r1,
+                 to_native(fg), to_native(bg));
+    gfx_mark_dirty(x, y, 8, 16);
+}
+
+// n characters from s, not stopping at NUL. One clip check for the run, only
+// a run hanging off the screen is drawn glyph by glyph.
+void gfx_draw_span(int x, int y, const char* s, int n, uint32_t fg, uint32_t bg) {
+    if (n <= 0)
+        return;
+
+    if (x < clip.x0 || y < clip.y0 || x + n * 8 > clip.x1 || y + 16 > clip.y1) {
+        for (int i = 0; i < n; i++)
+            gfx_draw_char(x + i * 8, y, s[i], fg, bg);
+        return;
+    }
+
+    uint32_t* dst = shadow_row(y) + x;
+    fg = to_native(fg);
+    bg = to_native(bg);
+
+    if (n >= GLYPH_SIMD_MIN && simd_level() >= SIMD_SSE2) {
+        kernel_fpu_begin();
+        glyph_run_sse2(dst, s, n, fg, bg);
+        kernel_fpu_end();
+    } else {
+        for (int i = 0; i < n; i++)
+            glyph_opaque(dst + i * 8, FONT8x16_ADDR[(uint8_t)s[i]], 0, 8, 0, 16, fg, bg);
+    }
+    gfx_mark_dirty(x, y, n * 8, 16);
+}
+
 void gfx_draw_text(int x, int y, const char* s, uint32_t fg, uint32_t bg) {
-    for (int i = 0; s[i]; ++i)
-        gfx_draw_char(x + i * 8, y, s[i], fg, bg);
+    gfx_draw_span(x, y, s, (int)strlen(s), fg, bg);
 }
 
 uint32_t gfx_get_pixel(int x, int y) {
     if ((unsigned)x >= G.w || (unsigned)y >= G.h)
         return 0;
 
-    uint32_t bgr = *(uint32_t*)(LFB + (size_t)y * G.pitch + (size_t)x * 4);
+    return from_native(shadow_row(y)[x]);
+}
+
+// Converts rows [y0, y1) of a full-screen RGB image into the shadow. Both
+// sides are packed at w pixels per row, so the band is one contiguous run.
+void gfx_blit_rows(const uint32_t* src, int y0, int y1) {
+    if (y1 <= y0)
+        return;
 
-    // memory: 0x00BBGGRR -> returns: 0x00RRGGBB
-    uint32_t rr = (bgr & 0x000000FF) << 16;
-    uint32_t gg = (bgr & 0x0000FF00);
-    uint32_t bb = (bgr & 0x00FF0000) >> 16;
-    return rr | gg | bb;
+    convert_run(shadow_row(y0), src + (size_t)y0 * G.w, (size_t)(y1 - y0) * G.w, 0);
+    gfx_mark_dirty(0, y0, G.w, y1 - y0);
+}
+
+static void blit_rows(void* arg, int y0, int y1) {
+    gfx_blit_rows((const uint32_t*)arg, y0, y1);
 }
 
 void gfx_blit_rgb(const uint32_t* src) {
@@ -145,33 +688,527 @@ void gfx_blit_rgb(const uint32_t* src) {
     if (!gi || gi->bpp != 32)
         return;
 
-    uint32_t* dst;
-    int y;
+    sched_parallel_for(gi->h, 1, blit_rows, (void*)src);
+}
+
+typedef struct {
+    const uint32_t* src; // Top-left source pixel of the clipped rect
+    int stride;
+    int dx, dy, w;
+    int native;
+} blit_rect_t;
+
+static void blit_rect_rows(void* arg, int r0, int r1) {
+    const blit_rect_t* b = (const blit_rect_t*)arg;
+
+    // Source and shadow both packed at w pixels per row: one contiguous run
+    if (b->w == G.w && b->stride == G.w) {
+        convert_run(shadow_row(b->dy + r0), b->src + (size_t)r0 * G.w,
+                    (size_t)(r1 - r0) * G.w, b->native);
+        return;
+    }
+
+    for (int r = r0; r < r1; r++)
+        convert_run(shadow_row(b->dy + r) + b->dx, b->src + (size_t)r * b->stride, (size_t)b->w, b->native);
+}
+
+// Reports the part of a w*h area at (x, y) inside the clip rect, w = h = 0
+// if none. out may be NULL.
+static void set_drawn(gfx_rect_t* out, int x, int y, int w, int h) {
+    if (!out)
+        return;
+
+    int x1 = x + w, y1 = y + h;
 
-    for (y = 0; y < gi->h; y++) {
-        dst = (uint32_t*)(uintptr_t)(gi->fb + (size_t)y * gi->pitch);
+    if (x < clip.x0) x = clip.x0;
+    if (y < clip.y0) y = clip.y0;
+    if (x1 > clip.x1) x1 = clip.x1;
+    if (y1 > clip.y1) y1 = clip.y1;
 
-        for (int x = 0; x < gi->w; x++) {
-            uint32_t rgb = src[y * gi->w + x];
+    if (x >= x1 || y >= y1)
+        *out = (gfx_rect_t){ 0, 0, 0, 0 };
+    else
+        *out = (gfx_rect_t){ x, y, x1 - x, y1 - y };
+}
+
+// Trims a w*h window read at (sx, sy) from a source 'stride' pixels wide and
+// 'rows' tall, written at (dx, dy), to both the source and the clip rect.
+// 0 if nothing is left.
+static int clip_window(int* sx, int* sy, int* dx, int* dy, int* w, int* h, int stride, int rows) {
+    if (*sx < 0) { *w += *sx; *dx -= *sx; *sx = 0; }
+    if (*sy < 0) { *h += *sy; *dy -= *sy; *sy = 0; }
+    if (*dx < clip.x0) { *w -= clip.x0 - *dx; *sx += clip.x0 - *dx; *dx = clip.x0; }
+    if (*dy < clip.y0) { *h -= clip.y0 - *dy; *sy += clip.y0 - *dy; *dy = clip.y0; }
+    if (*dx + *w > clip.x1) *w = clip.x1 - *dx;
+    if (*dy + *h > clip.y1) *h = clip.y1 - *dy;
+    if (*sx + *w > stride) *w = stride - *sx;
+    if (*sy + *h > rows) *h = rows - *sy;
+
+    return *w > 0 && *h > 0;
+}
+
+// Converts a w*h window of an RGB image with 'stride' pixels per row into the
+// shadow at (dx, dy), or copies it as is when 'native'. Clipped to the screen
+// and to the source row; returns how many pixels were written and the area
+// they cover in *drawn (may be NULL).
+int gfx_blit_rect(const uint32_t* src, const gfx_blit_rect_t* r, int native, gfx_rect_t* drawn) {
+    int stride = (int)r->stride;
+    int sx = r->sx, sy = r->sy, dx = r->dx, dy = r->dy, w = r->w, h = r->h;
+
+    set_drawn(drawn, 0, 0, 0, 0);
+    if (!gfx_ready || !src || stride <= 0)
+        return 0;
+    if (!clip_window(&sx, &sy, &dx, &dy, &w, &h, stride, 0x7FFF))
+        return 0;
+    set_drawn(drawn, dx, dy, w, h);
+
+    blit_rect_t b = { src + (size_t)sy * stride + sx, stride, dx, dy, w, native };
+
+    if (h >= FLUSH_PARALLEL_ROWS)
+        sched_parallel_for(h, 1, blit_rect_rows, &b);
+    else
+        blit_rect_rows(&b, 0, h);
+
+    gfx_mark_dirty(dx, dy, w, h);
+    return w * h;
+}
+
+// Moves a w*h screen area from (sx, sy) to (dx, dy), overlap allowed
+int gfx_copy_rect(int sx, int sy, int dx, int dy, int w, int h, gfx_rect_t* drawn) {
+    set_drawn(drawn, 0, 0, 0, 0);
+    if (!gfx_ready || !clip_window(&sx, &sy, &dx, &dy, &w, &h, G.w, G.h))
+        return 0;
+    set_drawn(drawn, dx, dy, w, h);
+
+    // Walk away from the destination so no source row is overwritten first
+    if (dy > sy) {
+        for (int r = h - 1; r >= 0; r--)
+            memmove(shadow_row(dy + r) + dx, shadow_row(sy + r) + sx, (size_t)w * 4);
+    } else {
+        for (int r = 0; r < h; r++)
+            memmove(shadow_row(dy + r) + dx, shadow_row(sy + r) + sx, (size_t)w * 4);
+    }
+
+    gfx_mark_dirty(dx, dy, w, h);
+    return w * h;
+}
 
-            uint32_t bgr = ((rgb & 0x000000FF) << 16)
-                         |  (rgb & 0x0000FF00)
-                         | ((rgb & 0x00FF0000) >> 16);
+// dst = (src & 0xFFFFFF) == key ? dst : src, four pixels per compare
+// Realigns esp: k[] is read with aligned loads, and kernel entry leaves
+// the stack wherever the app had it
+__attribute__((target("sse2"), force_align_arg_pointer))
+static void sprite_row_sse2(uint32_t* dst, const uint32_t* src, int n, uint32_t key) {
+    uint32_t k[8] __attribute__((aligned(16))) = {
+        key, key, key, key, 0x00FFFFFF, 0x00FFFFFF, 0x00FFFFFF, 0x00FFFFFF,
+    };
+    int blocks = n / 4;
 
-            dst[x] = bgr;
+    if (blocks)
+        asm volatile(
+            "movdqa (%3), %%xmm6\n"
+            "movdqa 16(%3), %%xmm7\n"
+            "1:\n"
+            "movdqu (%1), %%xmm0\n"
+            "movdqa %%xmm0, %%xmm1\n"
+            "pand %%xmm7, %%xmm1\n"
+            "pcmpeqd %%xmm6, %%xmm1\n"
+            "movdqu (%0), %%xmm2\n"
+            "pand %%xmm1, %%xmm2\n"
+            "pandn %%xmm0, %%xmm1\n"
+            "por %%xmm1, %%xmm2\n"
+            "movdqu %%xmm2, (%0)\n"
+            "add $16, %0\n"
+            "add $16, %1\n"
+            "decl %2\n"
+            "jnz 1b\n"
+            : "+r"(dst), "+r"(src), "+m"(blocks)
+            : "r"(k)
+            : "xmm0", "xmm1", "xmm2", "xmm6", "xmm7", "memory", "cc");
+
+    for (int i = 0; i < (n & 3); i++)
+        if ((src[i] & 0x00FFFFFF) != key)
+            dst[i] = src[i];
+}
+
+// Copies a window of an RGB image like gfx_blit_rect, leaving the screen
+// alone wherever the source pixel is 'key'
+int gfx_sprite(const uint32_t* src, const gfx_blit_rect_t* r, uint32_t key, gfx_rect_t* drawn) {
+    int stride = (int)r->stride;
+    int sx = r->sx, sy = r->sy, dx = r->dx, dy = r->dy, w = r->w, h = r->h;
+
+    set_drawn(drawn, 0, 0, 0, 0);
+    if (!gfx_ready || !src || stride <= 0)
+        return 0;
+    if (!clip_window(&sx, &sy, &dx, &dy, &w, &h, stride, 0x7FFF))
+        return 0;
+    set_drawn(drawn, dx, dy, w, h);
+
+    const uint32_t* s = src + (size_t)sy * stride + sx;
+    key &= 0x00FFFFFF;
+
+    if (G.format == GFX_FMT_XRGB && w >= 4 && simd_level() >= SIMD_SSE2) {
+        kernel_fpu_begin();
+        for (int y = 0; y < h; y++)
+            sprite_row_sse2(shadow_row(dy + y) + dx, s + (size_t)y * stride, w, key);
+        kernel_fpu_end();
+    } else {
+        for (int y = 0; y < h; y++) {
+            uint32_t* d = shadow_row(dy + y) + dx;
+            const uint32_t* row = s + (size_t)y * stride;
+
+            for (int x = 0; x < w; x++)
+                if ((row[x] & 0x00FFFFFF) != key)
+                    d[x] = to_native(row[x]);
         }
     }
+
+    gfx_mark_dirty(dx, dy, w, h);
+    return w * h;
+}
+
+// s over d, both 0x..RRGGBB, s carrying its alpha in the top byte.
+// (c + 128 + ((c + 128) >> 8)) >> 8 is c / 255 rounded for c <= 255 * 255.
+static inline uint32_t blend_px(uint32_t d, uint32_t s) {
+    uint32_t a = s >> 24, ia = 255 - a, out = 0;
+
+    for (int sh = 0; sh < 24; sh += 8) {
+        uint32_t c = ((s >> sh) & 0xFF) * a + ((d >> sh) & 0xFF) * ia + 128;
+        out |= ((c + (c >> 8)) >> 8) << sh;
+    }
+    return out;
+}
+
+// blend_px on four pixels at a time: bytes widened to words, pmullw for
+// s * a + d * (255 - a), then the same rounding shift
+__attribute__((target("sse2"), force_align_arg_pointer))
+static void blend_row_sse2(uint32_t* dst, const uint32_t* src, int n) {
+    uint16_t k[24] __attribute__((aligned(16))) = {
+        255, 255, 255, 255, 255, 255, 255, 255,
+        128, 128, 128, 128, 128, 128, 128, 128,
+        0xFFFF, 0x00FF, 0xFFFF, 0x00FF, 0xFFFF, 0x00FF, 0xFFFF, 0x00FF, // Top byte 0, as blend_px
+    };
+    int blocks = n / 4;
+
+    if (blocks)
+        asm volatile(
+            "pxor %%xmm7, %%xmm7\n"
+            "movdqa (%3), %%xmm6\n"
+            "1:\n"
+            "movdqu (%1), %%xmm0\n"
+            "movdqu (%0), %%xmm1\n"
+            // Pixels 0-1
+            "movdqa %%xmm0, %%xmm2\n"
+            "punpcklbw %%xmm7, %%xmm2\n"
+            "movdqa %%xmm1, %%xmm4\n"
+            "punpcklbw %%xmm7, %%xmm4\n"
+            "punpckhbw %%xmm7, %%xmm1\n"
+            "pshuflw $0xFF, %%xmm2, %%xmm5\n"
+            "pshufhw $0xFF, %%xmm5, %%xmm5\n"
+            "movdqa %%xmm6, %%xmm3\n"
+            "psubw %%xmm5, %%xmm3\n"
+            "pmullw %%xmm5, %%xmm2\n"
+            "pmullw %%xmm3, %%xmm4\n"
+            "paddw %%xmm4, %%xmm2\n"
+            "paddw 16(%3), %%xmm2\n"
+            "movdqa %%xmm2, %%xmm3\n"
+            "psrlw $8, %%xmm3\n"
+            "paddw %%xmm3, %%xmm2\n"
+            "psrlw $8, %%xmm2\n"
+            // Pixels 2-3, destination half already widened in xmm1
+            "movdqa %%xmm0, %%xmm3\n"
+            "punpckhbw %%xmm7, %%xmm3\n"
+            "pshuflw $0xFF, %%xmm3, %%xmm5\n"
+            "pshufhw $0xFF, %%xmm5, %%xmm5\n"
+            "movdqa %%xmm6, %%xmm4\n"
+            "psubw %%xmm5, %%xmm4\n"
+            "pmullw %%xmm5, %%xmm3\n"
+            "pmullw %%xmm4, %%xmm1\n"
+            "paddw %%xmm1, %%xmm3\n"
+            "paddw 16(%3), %%xmm3\n"
+            "movdqa %%xmm3, %%xmm4\n"
+            "psrlw $8, %%xmm4\n"
+            "paddw %%xmm4, %%xmm3\n"
+            "psrlw $8, %%xmm3\n"
+            "packuswb %%xmm3, %%xmm2\n"
+            "pand 32(%3), %%xmm2\n"
+            "movdqu %%xmm2, (%0)\n"
+            "add $16, %0\n"
+            "add $16, %1\n"
+            "decl %2\n"
+            "jnz 1b\n"
+            : "+r"(dst), "+r"(src), "+m"(blocks)
+            : "r"(k)
+            : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+              "memory", "cc");
+
+    for (int i = 0; i < (n & 3); i++)
+        dst[i] = blend_px(dst[i], src[i]);
 }
 
+// Blends a window of 0xAARRGGBB pixels over the screen, alpha 255 = opaque
+int gfx_blend(const uint32_t* src, const gfx_blit_rect_t* r, gfx_rect_t* drawn) {
+    int stride = (int)r->stride;
+    int sx = r->sx, sy = r->sy, dx = r->dx, dy = r->dy, w = r->w, h = r->h;
+
+    set_drawn(drawn, 0, 0, 0, 0);
+    if (!gfx_ready || !src || stride <= 0)
+        return 0;
+    if (!clip_window(&sx, &sy, &dx, &dy, &w, &h, stride, 0x7FFF))
+        return 0;
+    set_drawn(drawn, dx, dy, w, h);
+
+    const uint32_t* s = src + (size_t)sy * stride + sx;
+
+    if (G.format == GFX_FMT_XRGB && w >= 4 && simd_level() >= SIMD_SSE2) {
+        kernel_fpu_begin();
+        for (int y = 0; y < h; y++)
+            blend_row_sse2(shadow_row(dy + y) + dx, s + (size_t)y * stride, w);
+        kernel_fpu_end();
+    } else {
+        for (int y = 0; y < h; y++) {
+            uint32_t* d = shadow_row(dy + y) + dx;
+            const uint32_t* row = s + (size_t)y * stride;
+
+            for (int x = 0; x < w; x++)
+                d[x] = to_native(blend_px(from_native(d[x]), row[x]));
+        }
+    }
+
+    gfx_mark_dirty(dx, dy, w, h);
+    return w * h;
+}
+
+// One SYSCALL_GFX_DRAW operation, -1 for an unknown op. *drawn gets the
+// screen area it covered.
+int gfx_draw(const gfx_draw_t* d, gfx_rect_t* drawn) {
+    gfx_blit_rect_t r = { d->stride, d->sx, d->sy, d->x, d->y, d->w, d->h };
+
+    switch (d->op) {
+    case GFX_OP_FILL:
+        gfx_fillrect(d->x, d->y, d->w, d->h, d->color);
+        set_drawn(drawn, d->x, d->y, d->w, d->h);
+        return 0;
+    case GFX_OP_HLINE:
+        gfx_hline(d->x, d->y, d->w, d->color);
+        set_drawn(drawn, d->x, d->y, d->w, 1);
+        return 0;
+    case GFX_OP_VLINE:
+        gfx_vline(d->x, d->y, d->h, d->color);
+        set_drawn(drawn, d->x, d->y, 1, d->h);
+        return 0;
+    case GFX_OP_LINE:
+        gfx_line(d->x, d->y, d->sx, d->sy, d->color);
+        set_drawn(drawn, d->x < d->sx ? d->x : d->sx, d->y < d->sy ? d->y : d->sy,
+                  (d->x < d->sx ? d->sx - d->x : d->x - d->sx) + 1,
+                  (d->y < d->sy ? d->sy - d->y : d->y - d->sy) + 1);
+        return 0;
+    case GFX_OP_COPY:
+        gfx_copy_rect(d->sx, d->sy, d->x, d->y, d->w, d->h, drawn);
+        return 0;
+    case GFX_OP_SPRITE:
+        gfx_sprite(d->src, &r, d->color, drawn);
+        return 0;
+    case GFX_OP_BLEND:
+        gfx_blend(d->src, &r, drawn);
+        return 0;
+    }
+    set_drawn(drawn, 0, 0, 0, 0);
+    return -1;
+}
+
+// Grows b (x0, y0, x1, y1) by a w*h area at (x, y), clipped
+static void bounds_add(int* b, int x, int y, int w, int h) {
+    gfx_rect_t r;
+
+    set_drawn(&r, x, y, w, h);
+    if (r.w == 0)
+        return;
+
+    x = r.x; y = r.y;
+    int x1 = r.x + r.w, y1 = r.y + r.h;
+
+    if (b[0] >= b[2]) {
+        b[0] = x; b[1] = y; b[2] = x1; b[3] = y1;
+        return;
+    }
+    if (x < b[0]) b[0] = x;
+    if (y < b[1]) b[1] = y;
+    if (x1 > b[2]) b[2] = x1;
+    if (y1 > b[3]) b[3] = y1;
+}
+
+// Rasterizes a SYSCALL_GFX_CMDS buffer. bounds gets the screen area drawn
+// over as x0, y0, x1, y1 (empty when x0 >= x1). Returns the number of commands
+// run, or -1 at the first malformed one; the clip is the whole screen again
+// either way.
+int gfx_exec(const uint8_t* buf, uint32_t size, int* bounds) {
+    rect_t stack[GFX_CLIP_DEPTH];
+    int depth = 0, count = 0, err = 0;
+    uint32_t off = 0;
+
+    bounds[0] = bounds[1] = bounds[2] = bounds[3] = 0;
+    if (!gfx_ready)
+        return -1;
+
+    while (off + sizeof(gfx_cmd_t) <= size) {
+        const gfx_cmd_t* c = (const gfx_cmd_t*)(buf + off);
+
+        if (c->size < sizeof(gfx_cmd_t) || (c->size & 3) || c->size > size - off) {
+            err = 1;
+            break;
+        }
+
+        if (c->op == GFX_CMD_FILL && c->size >= sizeof(gfx_cmd_rect_t)) {
+            const gfx_cmd_rect_t* r = (const gfx_cmd_rect_t*)c;
+
+            gfx_fillrect(r->x, r->y, r->w, r->h, r->color);
+            bounds_add(bounds, r->x, r->y, r->w, r->h);
+        } else if (c->op == GFX_CMD_LINE && c->size >= sizeof(gfx_cmd_line_t)) {
+            const gfx_cmd_line_t* l = (const gfx_cmd_line_t*)c;
+            int x = l->x0 < l->x1 ? l->x0 : l->x1, y = l->y0 < l->y1 ? l->y0 : l->y1;
+
+            gfx_line(l->x0, l->y0, l->x1, l->y1, l->color);
+            bounds_add(bounds, x, y, (l->x0 < l->x1 ? l->x1 - l->x0 : l->x0 - l->x1) + 1,
+                       (l->y0 < l->y1 ? l->y1 - l->y0 : l->y0 - l->y1) + 1);
+        } else if (c->op == GFX_CMD_TEXT && c->size >= sizeof(gfx_cmd_text_t) &&
+                   ((const gfx_cmd_text_t*)c)->len <= c->size - sizeof(gfx_cmd_text_t)) {
+            const gfx_cmd_text_t* t = (const gfx_cmd_text_t*)c;
+            const char* text = (const char*)(t + 1);
+
+            if (t->flags & GFX_TEXT_FG_ONLY) {
+                for (int i = 0; i < t->len; i++)
+                    gfx_draw_char_fg(t->x + i * 8, t->y, text[i], t->fg);
+            } else {
+                gfx_draw_span(t->x, t->y, text, t->len, t->fg, t->bg);
+            }
+            bounds_add(bounds, t->x, t->y, t->len * 8, 16);
+        } else if (c->op == GFX_CMD_SPRITE && c->size >= sizeof(gfx_cmd_sprite_t)) {
+            const gfx_cmd_sprite_t* sp = (const gfx_cmd_sprite_t*)c;
+            gfx_blit_rect_t r = { sp->stride, sp->sx, sp->sy, sp->x, sp->y, sp->w, sp->h };
+            gfx_rect_t drawn;
+
+            if (sp->key == GFX_NO_KEY)
+                gfx_blit_rect(sp->src, &r, 0, &drawn);
+            else
+                gfx_sprite(sp->src, &r, sp->key, &drawn);
+            bounds_add(bounds, drawn.x, drawn.y, drawn.w, drawn.h);
+        } else if (c->op == GFX_CMD_CLIP_PUSH && c->size >= sizeof(gfx_cmd_rect_t) &&
+                   depth < GFX_CLIP_DEPTH) {
+            const gfx_cmd_rect_t* r = (const gfx_cmd_rect_t*)c;
+
+            stack[depth++] = clip;
+            if (r->x > clip.x0) clip.x0 = r->x;
+            if (r->y > clip.y0) clip.y0 = r->y;
+            if (r->x + r->w < clip.x1) clip.x1 = r->x + r->w;
+            if (r->y + r->h < clip.y1) clip.y1 = r->y + r->h;
+            // Nothing left: keep an empty rect rather than an inverted one
+            if (clip.x1 < clip.x0) clip.x1 = clip.x0;
+            if (clip.y1 < clip.y0) clip.y1 = clip.y0;
+        } else if (c->op == GFX_CMD_CLIP_POP && depth > 0) {
+            clip = stack[--depth];
+        } else {
+            err = 1;
+            break;
+        }
+
+        off += c->size;
+        count++;
+    }
+
+    clip = (rect_t){ 0, 0, G.w, G.h };
+    return err ? -1 : count;
+}
+
+uint32_t gfx_native(uint32_t rgb) {
+    return to_native(rgb);
+}
+
+// Transparent glyphs, each row two 16-byte blends: dst ^= (dst ^ fg) & mask.
+// Realigns esp for the movdqa of fg[], see glyph_run_sse2.
+__attribute__((target("sse2"), force_align_arg_pointer))
+static void overlay_sse2(uint32_t* row, const gfx_glyph_t* g, int n) {
+    uint32_t fg[4] __attribute__((aligned(16)));
+    uint32_t pitch = (uint32_t)G.w * 4;
+
+    for (int i = 0; i < n; i++) {
+        uint32_t* d = row + g[i].x;
+        const uint8_t* bits = FONT8x16_ADDR[g[i].ch];
+        int rows = 16;
+
+        fg[0] = fg[1] = fg[2] = fg[3] = g[i].fg;
+
+        asm volatile(
+            "movdqa (%3), %%xmm7\n"
+            "1:\n"
+            "movzbl (%1), %%eax\n"
+            "shl $5, %%eax\n"
+            "movdqu (%0), %%xmm0\n"
+            "movdqu 16(%0), %%xmm1\n"
+            "movdqa %%xmm0, %%xmm2\n"
+            "movdqa %%xmm1, %%xmm3\n"
+            "pxor %%xmm7, %%xmm2\n"
+            "pxor %%xmm7, %%xmm3\n"
+            "pand (%4,%%eax), %%xmm2\n"
+            "pand 16(%4,%%eax), %%xmm3\n"
+            "pxor %%xmm2, %%xmm0\n"
+            "pxor %%xmm3, %%xmm1\n"
+            "movdqu %%xmm0, (%0)\n"
+            "movdqu %%xmm1, 16(%0)\n"
+            "add %5, %0\n"
+            "inc %1\n"
+            "decl %2\n"
+            "jnz 1b\n"
+            : "+r"(d), "+r"(bits), "+m"(rows)
+            : "r"(fg), "r"(glyph_mask), "m"(pitch)
+            : "eax", "xmm0", "xmm1", "xmm2", "xmm3", "xmm7", "memory", "cc");
+    }
+}
+
+// Composites a cached line of text onto shadow rows [y, y + 16). Doesn't
+// mark anything dirty, it rides along with the blit that covered the rows.
+void gfx_overlay_row(int y, const gfx_glyph_t* g, int n) {
+    if (n <= 0 || y < 0 || y + 16 > G.h)
+        return;
+
+    uint32_t* row = shadow_row(y);
+
+    if (simd_level() >= SIMD_SSE2) {
+        kernel_fpu_begin();
+        overlay_sse2(row, g, n);
+        kernel_fpu_end();
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        const uint8_t* bits = FONT8x16_ADDR[g[i].ch];
+        uint32_t* dst = row + g[i].x;
+
+        for (int dy = 0; dy < 16; dy++, dst += G.w) {
+            const uint32_t* m = glyph_mask[bits[dy]];
+
+            for (int k = 0; k < 8; k++)
+                dst[k] ^= (dst[k] ^ g[i].fg) & m[k];
+        }
+    }
+}
+
+// Transparent background: only the set bits are written
 void gfx_draw_char_fg(int x, int y, char c, uint32_t fg) {
     const uint8_t* g = FONT8x16_ADDR[(uint8_t)c];
+    int c0 = (x < clip.x0) ? clip.x0 - x : 0, c1 = (x + 8 > clip.x1) ? clip.x1 - x : 8;
+    int r0 = (y < clip.y0) ? clip.y0 - y : 0, r1 = (y + 16 > clip.y1) ? clip.y1 - y : 16;
 
-    for (int dy = 0; dy < 16; dy++) {
-        uint8_t bits = g[dy];
+    if (c0 >= c1 || r0 >= r1)
+        return;
 
-        for (int dx = 0; dx < 8; dx++) {
-            if (bits & (0x80 >> dx))
-                gfx_putpixel(x + dx, y + dy, fg);
-        }
+    uint32_t* dst = SHADOW + (y + r0) * G.w + x;
+    fg = to_native(fg);
+
+    for (int dy = r0; dy < r1; dy++, dst += G.w) {
+        const uint32_t* m = glyph_mask[g[dy]];
+
+        for (int i = c0; i < c1; i++)
+            dst[i] ^= (dst[i] ^ fg) & m[i];
     }
+    gfx_mark_dirty(x, y, 8, 16);
 }
@@ -1,21 +1,148 @@
 #pragma once
 #include <stdint.h>
 
+// Framebuffer pixel layouts. Apps draw 0x00RRGGBB, which is GFX_FMT_XRGB.
+enum {
+    GFX_FMT_XRGB = 0,  // Red in bits 16-23, blue in 0-7: no conversion
+    GFX_FMT_XBGR = 1,  // Red and blue swapped
+    GFX_FMT_OTHER = 2, // Anything else the masks describe, converted per channel
+};
+
 typedef struct {
     uint32_t fb;
     uint16_t w, h; // Resolution
     uint16_t pitch; // Bytes per line
     uint8_t bpp;
+    uint8_t format; // GFX_FMT_*
+    uint8_t r_size, r_pos; // Channel mask width and bit position, from ModeInfo
+    uint8_t g_size, g_pos;
+    uint8_t b_size, b_pos;
 } gfx_info_t;
 
+// One entry of a SYSCALL_GFX_BLIT_RECT/_NATIVE list. Source pixels are
+// 0x00RRGGBB, or already in the framebuffer's format for the native call,
+// with 'stride' pixels per row; (sx, sy) is read and written at (dx, dy).
+typedef struct {
+    uint32_t stride;
+    int16_t sx, sy;
+    int16_t dx, dy;
+    int16_t w, h;
+} gfx_blit_rect_t;
+
+
+// Screen area a primitive actually wrote after clipping, w = h = 0 if none
+typedef struct {
+    int x, y, w, h;
+} gfx_rect_t;
+
+// SYSCALL_GFX_DRAW operations
+enum {
+    GFX_OP_FILL = 0,   // w*h of color at (x, y)
+    GFX_OP_HLINE = 1,  // w pixels right of (x, y)
+    GFX_OP_VLINE = 2,  // h pixels down from (x, y)
+    GFX_OP_LINE = 3,   // (x, y) to (sx, sy), both ends drawn
+    GFX_OP_COPY = 4,   // Screen w*h at (sx, sy) moved to (x, y)
+    GFX_OP_SPRITE = 5, // Window (sx, sy) of src to (x, y), pixels equal to color skipped
+    GFX_OP_BLEND = 6,  // Same window of 0xAARRGGBB src blended over the screen
+};
+
+// One 2D primitive, clipped to the screen. Colours are 0x00RRGGBB.
+typedef struct {
+    uint16_t op; // GFX_OP_*
+    uint16_t reserved;
+    int16_t x, y;
+    int16_t w, h;
+    int16_t sx, sy;
+    uint32_t color;
+    uint32_t stride;     // src pixels per row
+    const uint32_t* src; // GFX_OP_SPRITE and GFX_OP_BLEND
+} gfx_draw_t;
+
+// SYSCALL_GFX_CMDS buffer: commands packed back to back, each starting with
+// gfx_cmd_t whose size covers the whole command, a multiple of 4 bytes.
+enum {
+    GFX_CMD_FILL = 1,      // gfx_cmd_rect_t
+    GFX_CMD_LINE = 2,      // gfx_cmd_line_t
+    GFX_CMD_TEXT = 3,      // gfx_cmd_text_t
+    GFX_CMD_SPRITE = 4,    // gfx_cmd_sprite_t
+    GFX_CMD_CLIP_PUSH = 5, // gfx_cmd_rect_t, intersected with the current clip
+    GFX_CMD_CLIP_POP = 6,  // gfx_cmd_t
+};
+
+#define GFX_CLIP_DEPTH 8
+#define GFX_TEXT_FG_ONLY 0x0001 // Leave the background showing through
+#define GFX_NO_KEY 0xFFFFFFFF   // Sprite without a transparent colour
+
+typedef struct {
+    uint16_t op; // GFX_CMD_*
+    uint16_t size;
+} gfx_cmd_t;
+
+typedef struct {
+    gfx_cmd_t hdr;
+    int16_t x, y, w, h;
+    uint32_t color;
+} gfx_cmd_rect_t;
+
+typedef struct {
+    gfx_cmd_t hdr;
+    int16_t x0, y0, x1, y1;
+    uint32_t color;
+} gfx_cmd_line_t;
+
+// Followed by len characters, padded up to the command size
+typedef struct {
+    gfx_cmd_t hdr;
+    int16_t x, y;
+    uint32_t fg, bg;
+    uint16_t len;
+    uint16_t flags; // GFX_TEXT_*
+} gfx_cmd_text_t;
+
+typedef struct {
+    gfx_cmd_t hdr;
+    int16_t x, y, w, h; // Destination
+    int16_t sx, sy;     // Window corner in src
+    uint32_t stride;
+    uint32_t key;       // 0x00RRGGBB left out, or GFX_NO_KEY
+    const uint32_t* src;
+} gfx_cmd_sprite_t;
+
+// One glyph of a cached text overlay, see gfx_overlay_row
+typedef struct {
+    uint16_t x;
+    uint8_t ch;
+    uint8_t reserved;
+    uint32_t fg; // Already native, see gfx_native
+} gfx_glyph_t;
 
 int gfx_init(void);
 void gfx_clear(uint32_t rgba);
 void gfx_putpixel(int x, int y, uint32_t rgba);
 void gfx_fillrect(int x,int y,int w,int h, uint32_t rgba);
+void gfx_hline(int x, int y, int w, uint32_t rgb);
+void gfx_vline(int x, int y, int h, uint32_t rgb);
+void gfx_line(int x0, int y0, int x1, int y1, uint32_t rgb);
+int gfx_copy_rect(int sx, int sy, int dx, int dy, int w, int h, gfx_rect_t* drawn);
+int gfx_sprite(const uint32_t* src, const gfx_blit_rect_t* r, uint32_t key, gfx_rect_t* drawn);
+int gfx_blend(const uint32_t* src, const gfx_blit_rect_t* r, gfx_rect_t* drawn);
+int gfx_draw(const gfx_draw_t* d, gfx_rect_t* drawn);
+int gfx_exec(const uint8_t* buf, uint32_t size, int* bounds);
 void gfx_draw_char(int x,int y, char c, uint32_t fg, uint32_t bg);
 void gfx_draw_text(int x,int y, const char* s, uint32_t fg, uint32_t bg);
+void gfx_draw_span(int x, int y, const char* s, int n, uint32_t fg, uint32_t bg);
 void gfx_blit_rgb(const uint32_t* src);
+void gfx_blit_rows(const uint32_t* src, int y0, int y1);
+int gfx_blit_rect(const uint32_t* src, const gfx_blit_rect_t* r, int native, gfx_rect_t* drawn);
 uint32_t gfx_get_pixel(int x, int y);
 const gfx_info_t* gfx_info(void);
 void gfx_draw_char_fg(int x, int y, char c, uint32_t fg);
+uint32_t gfx_native(uint32_t rgb);
+void gfx_overlay_row(int y, const gfx_glyph_t* g, int n);
+void gfx_mark_dirty(int x, int y, int w, int h);
+void gfx_flush(void);
+void gfx_scroll_up(int h, int dy, uint32_t rgb);
+int gfx_page_flipping(void);
+void gfx_cursor_set_shape(const uint8_t* mask, int w, int h, uint32_t rgb);
+void gfx_cursor_move(int x, int y);
+void gfx_cursor_show(int visible);
@@ -2,8 +2,12 @@
 #include "irq.h"
 #include "idt.h"
 #include "pic.h"
+#include "apic.h"
 #include "console.h"
 #include "io.h"
+#include "cpu.h"
+#include "softirq.h"
+#include "../lib/string.h"
 
 extern void irq0();   extern void irq1();   extern void irq2();   extern void irq3();
 extern void irq4();   extern void irq5();   extern void irq6();   extern void irq7();
@@ -11,6 +15,7 @@ extern void irq8();   extern void irq9();   extern void irq10();  extern void ir
 extern void irq12();  extern void irq13();  extern void irq14();  extern void irq15();
 
 void (*interrupt_handlers[16])(regs_t *r); // Holds various IRQ (0-15)
+static irq_stat_t stats[16];
 
 void irq_install(void) {
     idt_set_gate(32, (uint32_t)irq0,  0x08, 0x8E);
@@ -34,6 +39,14 @@ void irq_install(void) {
     outb(0xA1, inb(0xA1) | (1 << 6));
 }
 
+// Masks/unmasks a line on whichever controller is delivering interrupts
+void irq_set_mask(uint8_t irq, int masked) {
+    if (apic_enabled())
+        ioapic_set_mask(irq, masked);
+    else
+        pic_set_mask(irq, masked);
+}
+
 // Registers custom handler for a IRQ
 void register_interrupt_handler(uint8_t irq, void (*handler)(regs_t *r)) {
     interrupt_handlers[irq] = handler;
@@ -43,7 +56,14 @@ void irq_handler(regs_t *r) {
     uint8_t irq = r->int_no - 32; // 32-47 -> IRQ 0-15
 
     if (interrupt_handlers[irq]) {
+        uint64_t t0 = rdtsc();
         interrupt_handlers[irq](r); // Call real handler
+        uint64_t dt = rdtsc() - t0;
+
+        stats[irq].count++;
+        stats[irq].total_cycles += dt;
+        if (dt > stats[irq].max_cycles)
+            stats[irq].max_cycles = dt;
     }
     else {
         console_write("Unhandled IRQ: ");
@@ -55,6 +75,20 @@ void irq_handler(regs_t *r) {
         console_write("\n");
     }
 
-    // Send EOI to the PIC (end of interrupt)
-    pic_send_eoi(irq);
+    // Send EOI (end of interrupt), one MMIO write on the local APIC
+    if (apic_enabled())
+        lapic_eoi();
+    else
+        pic_send_eoi(irq);
+
+    // Deferred work runs after the EOI so the controller can deliver again
+    softirq_run();
+}
+
+const irq_stat_t* irq_stats(void) {
+    return stats;
+}
+
+void irq_stats_reset(void) {
+    memset(stats, 0, sizeof(stats));
 }
@@ -2,6 +2,16 @@
 #include "isr.h"
 #include <stdint.h>
 
+typedef struct {
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t total_cycles;
+    uint64_t max_cycles; // Longest single run of the handler
+} irq_stat_t;
+
 void irq_install(void);
 void register_interrupt_handler(uint8_t irq, void (*handler)(regs_t *r));
 void irq_handler(regs_t *r);
+void irq_set_mask(uint8_t irq, int masked);
+const irq_stat_t* irq_stats(void);
+void irq_stats_reset(void);
@@ -21,6 +21,7 @@ irq%1:
     mov es, ax
     mov fs, ax
     mov gs, ax
+    cld                   ; C code expects DF=0, the interrupted code may not have it
 
     mov eax, esp
     push eax
@@ -2,6 +2,8 @@
 #include "isr.h"
 #include "idt.h"
 #include "console.h"
+#include "serial.h"
+#include "fpu.h"
 
 extern void isr0();  extern void isr1();  extern void isr2();  extern void isr3();
 extern void isr4();  extern void isr5();  extern void isr6();  extern void isr7();
@@ -60,6 +62,10 @@ void isr_install(void) {
 }
 
 void isr_handler(regs_t *r) {
+	// Lazy FPU switch, not an error
+	if (r->int_no == 7 && fpu_handle_nm() == 0)
+		return;
+
 	console_write("\n*** CPU EXCEPTION ***\n");
 	console_write("Type: ");
 
@@ -77,6 +83,7 @@ void isr_handler(regs_t *r) {
 	console_write("  ERR: ");
 	console_write(itoa((int)r->err_code, buf, 16));
 	console_write("\nSystem halted.\n");
+	serial_flush_sync(); // Interrupts stay off from here on
 
 	for(;;) asm volatile("hlt");
 }
@@ -21,6 +21,7 @@ isr%1:
     mov es, ax
     mov fs, ax
     mov gs, ax
+    cld                   ; C code expects DF=0, the interrupted code may not have it
 
     mov eax, esp          ; &regs_t
     push eax
@@ -50,6 +51,7 @@ isr%1:
     mov es, ax
     mov fs, ax
     mov gs, ax
+    cld                   ; C code expects DF=0, the interrupted code may not have it
 
     mov eax, esp
     push eax
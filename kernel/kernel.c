@@ -10,6 +10,14 @@
 #include "io.h"
 #include "mouse.h"
 #include "pit.h"
+#include "prof.h"
+#include "serial.h"
+#include "apic.h"
+#include "smp.h"
+#include "softirq.h"
+#include "fpu.h"
+#include "simd.h"
+#include "event.h"
 #include "../lib/stdlib.h"
 #include "../lib/string.h"
 
@@ -17,9 +25,10 @@ volatile unsigned int g_ticks = 0;
 static int s_inited = 0;
 
 void timer_handler(regs_t* r) {
-    (void)r;
     g_ticks++;
-    mouse_on_timer_tick();
+    prof_tick(r);
+    raise_softirq(SOFTIRQ_CURSOR);
+    raise_softirq(SOFTIRQ_FLUSH);
 }
 
 void kernel_run_shell_loop(void) {
@@ -40,6 +49,14 @@ void kernel_main(void) {
         if (use_gfx) gfx_clear(0x00000000);
         console_init(use_gfx);
         console_write("Console ready.\n");
+        if (use_gfx && gfx_page_flipping())
+            console_write("[BGA] Double buffered, flipping pages\n");
+
+        fpu_init();
+        simd_init();
+        console_write("SIMD blit kernels: ");
+        console_write(simd_name());
+        console_write("\n");
 
         console_write("Installing IDT...\n");
         idt_install();
@@ -57,19 +74,40 @@ void kernel_main(void) {
         irq_install();
         console_write("IRQ installed!\n");
 
+        console_write("Enabling APIC...\n");
+        if (apic_init() == 0)
+            console_write("Local APIC + I/O APIC enabled!\n");
+        else
+            console_write("No APIC in MADT, staying on the 8259 PIC.\n");
+
+        console_write("Starting serial log (COM1)...\n");
+        if (serial_init() == 0)
+            console_write("Serial log ready!\n");
+        else
+            console_write("No UART found, serial log disabled.\n");
+
+        softirq_register(SOFTIRQ_CURSOR, mouse_on_timer_tick);
+        softirq_register(SOFTIRQ_FLUSH, gfx_flush);
         register_interrupt_handler(0, timer_handler);
         pit_init(100);
 
-        uint8_t master = inb(0x21);
-        uint8_t slave  = inb(0xA1);
-        master &= ~((1<<0) | (1<<1)); // IRQ0 (PIT) and IRQ1 (KBD) enabled
-        slave  |=  (1<<6); // IRQ14 (IDE) ALWAYS enabled
-        outb(0x21, master);
-        outb(0xA1, slave);
+        // IRQ14 (IDE) stays masked, the ATA driver polls
+        irq_set_mask(0, 0); // PIT
+        irq_set_mask(1, 0); // KBD
+        irq_set_mask(4, 0); // COM1
+        irq_set_mask(12, 0); // PS/2 mouse
 
         console_write("Installing keyboard drivers...\n");
         kbd_install();
         console_write("Keyboard drivers installed!\n");
+        if (event_selfcheck() == 0)
+            console_write("Event queue check passed!\n");
+        else
+            console_write("Event queue check FAILED: key presses get dropped.\n");
+
+        console_write("Installing mouse driver...\n");
+        mouse_init(use_gfx);
+        console_write("Mouse driver installed!\n");
 
         console_write("Installing syscalls...\n");
         syscall_init();
@@ -82,6 +120,13 @@ void kernel_main(void) {
         asm volatile("sti");
         console_write("Interrupts enabled!\n");
 
+        console_write("Starting application processors...\n");
+        int ncpu = smp_init();
+        char nbuf[12];
+        console_write("[SMP] ");
+        console_write(itoa(ncpu, nbuf, 10));
+        console_write(" CPU(s) online\n");
+
         console_write("\n[KERNEL] Loading file system...\n");
         if (asofs_load_superblock() != 0) {
             console_write("[KERNEL] Filesystem not available. Halting.\n");
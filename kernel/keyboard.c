@@ -3,10 +3,13 @@
 #include "irq.h"
 #include "io.h"
 #include "vga.h"
+#include "event.h"
+#include "cpu.h"
 
 #define KBD_BUFFER_SIZE 128
 #define SCANCODE_SIZE 128
 #define KBD_BUFFER_MASK (KBD_BUFFER_SIZE - 1)
+#define KBD_EVENTS_MASK (KBD_EVENTS - 1)
 
 static int e0_prefix = 0;
 
@@ -33,72 +36,168 @@ static const unsigned char scancode_map_shift[SCANCODE_SIZE] = {
     '*', 0, ' ',
     0,
 };
-static int shift = 0;
-static uint8_t last_scancode = 0;
-static int key_released = 1;
+static uint8_t e1_skip = 0; // Bytes left of a Pause (E1) sequence
+static uint8_t caps_lock = 0;
 static char kbd_buffer[KBD_BUFFER_SIZE];
+static uint32_t kbd_seq[KBD_BUFFER_SIZE]; // Which key press each character came from
+static uint32_t kbd_next_seq = 0;
 static volatile int kbd_head = 0;
 static volatile int kbd_tail = 0;
 
-static inline void kbd_push(char c) {
+// Key state, shared read-only with apps through SYSCALL_KBD_STATE
+static kbd_shared_t kbd_shared;
+
+// SPSC: the IRQ handler produces, SYSCALL_KBD_READ consumes
+static kbd_event_t kbd_events[KBD_EVENTS];
+static volatile uint32_t ev_head = 0;
+static volatile uint32_t ev_tail = 0;
+
+// Returns the character's sequence number, KBD_NO_SEQ if the buffer was full
+static inline uint32_t kbd_push(char c) {
     int next = (kbd_head + 1) & KBD_BUFFER_MASK;
 
-    if (next != kbd_tail) {
-        kbd_buffer[kbd_head] = c;
-        kbd_head = next;
+    if (next == kbd_tail)
+        return KBD_NO_SEQ;
+
+    uint32_t seq = kbd_next_seq++;
+
+    if (kbd_next_seq == KBD_NO_SEQ)
+        kbd_next_seq = 0;
+    kbd_buffer[kbd_head] = c;
+    kbd_seq[kbd_head] = seq;
+    kbd_head = next;
+    return seq;
+}
+
+static inline int key_down(uint8_t key) {
+    return (kbd_shared.keys[key >> 5] >> (key & 31)) & 1;
+}
+
+static inline void key_set(uint8_t key, int down) {
+    if (down)
+        kbd_shared.keys[key >> 5] |= 1u << (key & 31);
+    else
+        kbd_shared.keys[key >> 5] &= ~(1u << (key & 31));
+}
+
+static uint8_t modifiers(void) {
+    uint8_t m = 0;
+
+    if (key_down(0x2A) || key_down(0x36)) m |= KMOD_SHIFT;
+    if (key_down(0x1D) || key_down(KBD_E0(0x1D))) m |= KMOD_CTRL;
+    if (key_down(0x38) || key_down(KBD_E0(0x38))) m |= KMOD_ALT;
+    if (caps_lock) m |= KMOD_CAPS;
+
+    return m;
+}
+
+// Extended keys that produce something, modifiers (RCtrl/RAlt) produce 0
+static uint8_t translate_e0(uint8_t code) {
+    switch (code) {
+    case 0x4B: return KEY_LEFT;
+    case 0x4D: return KEY_RIGHT;
+    case 0x48: return KEY_UP;
+    case 0x50: return KEY_DOWN;
+    case 0x47: return KEY_HOME;
+    case 0x4F: return KEY_END;
+    case 0x49: return KEY_PGUP;
+    case 0x51: return KEY_PGDN;
+    case 0x52: return KEY_INSERT;
+    case 0x53: return KEY_DELETE;
+    case 0x1C: return '\n'; // Keypad Enter
+    case 0x35: return '/';  // Keypad /
+    default:   return 0;
     }
 }
 
+static uint8_t translate(uint8_t code, uint8_t mods) {
+    if (code >= SCANCODE_SIZE)
+        return 0;
+
+    uint8_t c = scancode_map[code];
+
+    if (c >= 'a' && c <= 'z') {
+        // Caps Lock only flips letters, Shift cancels it
+        if (!(mods & KMOD_SHIFT) != !(mods & KMOD_CAPS))
+            c = scancode_map_shift[code];
+        if (mods & KMOD_CTRL)
+            c &= 0x1F; // Ctrl+A = 1 ...
+    }
+    else if (mods & KMOD_SHIFT) {
+        c = scancode_map_shift[code];
+    }
+
+    return c;
+}
+
+static void kbd_queue(uint16_t scancode, uint8_t keycode, uint8_t pressed, uint8_t mods) {
+    uint32_t tail = ev_tail;
+
+    if (tail - __atomic_load_n(&ev_head, __ATOMIC_ACQUIRE) >= KBD_EVENTS)
+        return; // Full, the reader is behind
+
+    kbd_event_t* e = &kbd_events[tail & KBD_EVENTS_MASK];
+    e->scancode = scancode;
+    e->keycode = keycode;
+    e->pressed = pressed;
+    e->modifiers = mods;
+    e->tsc = rdtsc();
+
+    __atomic_store_n(&ev_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
 void kbd_handler(regs_t *r) {
+    (void)r;
     uint8_t scancode = inb(0x60);
 
+    if (e1_skip) {
+        e1_skip--;
+        return;
+    }
+
+    // Pause sends E1 1D 45 E1 9D C5 and never a release, just swallow it
+    if (scancode == 0xE1) {
+        e1_skip = 2;
+        return;
+    }
+
     // Prefix E0, next scancode is extented
     if (scancode == 0xE0) {
         e0_prefix = 1;
-        outb(0x20, 0x20);
         return;
     }
 
-    if (scancode & 0x80) {
-        // Key released
-        uint8_t code = scancode & 0x7F;
+    int extended = e0_prefix;
+    int pressed = !(scancode & 0x80);
+    uint8_t code = scancode & 0x7F;
+    e0_prefix = 0;
 
-        if (e0_prefix) {
-            e0_prefix = 0;
-        } 
-        else {
-            if (code == 0x2A || code == 0x36) {
-                // Shift up
-                shift = 0;
-            }
-            // Other ignored releases
-        }
-    } else {
-        // Key pressed
-        if (e0_prefix) {
-            unsigned char kc = 0;
-
-            if (scancode == 0x4B) kc = KEY_LEFT;   // E0 4B
-            else if (scancode == 0x4D) kc = KEY_RIGHT; // E0 4D
-            else if (scancode == 0x48) kc = KEY_UP;    // E0 48
-            else if (scancode == 0x50) kc = KEY_DOWN;  // E0 50
-
-            if (kc) kbd_push((char)kc);
-            e0_prefix = 0; 
-        } 
-        else if (scancode == 0x2A || scancode == 0x36) {
-            // Shift down
-            shift = 1;
-        } else {
-            unsigned char c = shift ? scancode_map_shift[scancode]
-                                    : scancode_map[scancode];
-            if (c) kbd_push(c);
-        }
-    }
+    // E0 2A / E0 AA are fake shifts wrapped around PrtSc and friends
+    if (extended && code == 0x2A)
+        return;
 
-    outb(0x20, 0x20);
-}
+    uint8_t key = extended ? KBD_E0(code) : code;
+    uint16_t sc = extended ? (uint16_t)(0xE000 | code) : code;
+
+    if (pressed && code == 0x3A && !key_down(key))
+        caps_lock ^= 1;
+
+    key_set(key, pressed);
 
+    uint8_t mods = modifiers();
+    kbd_shared.modifiers = mods;
+
+    uint8_t kc = extended ? translate_e0(code) : translate(code, mods);
+
+    uint32_t seq = KBD_NO_SEQ;
+
+    if (pressed && kc)
+        seq = kbd_push((char)kc);
+
+    kbd_queue(sc, kc, (uint8_t)pressed, mods);
+    event_post_key(pressed ? EV_KEY_DOWN : EV_KEY_UP, sc, kc, seq);
+    // irq_handler sends the EOI
+}
 
 void kbd_install(void) {
     register_interrupt_handler(1, kbd_handler);
@@ -117,6 +216,57 @@ char kbd_getchar(void) {
     return c;
 }
 
+// Drops the character pushed as seq if getchar hasn't taken it yet: its key
+// press was delivered (or thrown away) as an event instead
+void kbd_discard(uint32_t seq) {
+    uint32_t flags;
+
+    if (seq == KBD_NO_SEQ)
+        return;
+
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+
+    for (int i = kbd_tail; i != kbd_head; i = (i + 1) & KBD_BUFFER_MASK) {
+        if (kbd_seq[i] != seq)
+            continue;
+
+        // Close the gap by moving the older characters up one slot
+        while (i != kbd_tail) {
+            int prev = (i - 1) & KBD_BUFFER_MASK;
+            kbd_buffer[i] = kbd_buffer[prev];
+            kbd_seq[i] = kbd_seq[prev];
+            i = prev;
+        }
+        kbd_tail = (kbd_tail + 1) & KBD_BUFFER_MASK;
+        break;
+    }
+
+    if (flags & 0x200)
+        asm volatile("sti" : : : "memory");
+}
+
+// Copies up to max queued key events, oldest first
+int kbd_read_events(kbd_event_t* out, int max) {
+    int n = 0;
+    uint32_t head = ev_head;
+
+    while (n < max && head != __atomic_load_n(&ev_tail, __ATOMIC_ACQUIRE)) {
+        out[n++] = kbd_events[head & KBD_EVENTS_MASK];
+        head++;
+    }
+
+    __atomic_store_n(&ev_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+void kbd_flush_events(void) {
+    __atomic_store_n(&ev_head, ev_tail, __ATOMIC_RELEASE);
+}
+
+const kbd_shared_t* kbd_shared_state(void) {
+    return &kbd_shared;
+}
+
 void kbd_readline(char *buf, int max_len) {
     int i = 0;
 
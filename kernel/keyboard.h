@@ -6,9 +6,46 @@
 #define KEY_RIGHT 0x91
 #define KEY_UP 0x92
 #define KEY_DOWN 0x93
+#define KEY_HOME 0x94
+#define KEY_END 0x95
+#define KEY_PGUP 0x96
+#define KEY_PGDN 0x97
+#define KEY_INSERT 0x98
+#define KEY_DELETE 0x99
+
+// Modifier bits
+#define KMOD_SHIFT 0x01
+#define KMOD_CTRL  0x02
+#define KMOD_ALT   0x04
+#define KMOD_CAPS  0x08
+
+// Key-state index: set-1 make code, E0 keys land in the upper half
+#define KBD_E0(code) (0x80 | (code))
+
+#define KBD_EVENTS 64 // Power of two
+
+typedef struct {
+    uint16_t scancode; // Make code, 0xE0xx for extended keys
+    uint8_t keycode;   // Character or KEY_*, 0 if the key has none
+    uint8_t pressed;   // 0 = release
+    uint8_t modifiers; // KMOD_* after this event
+    uint8_t reserved[3];
+    uint64_t tsc;
+} kbd_event_t;
+
+typedef struct {
+    uint32_t keys[8];  // Bit per KBD_E0-style index, 1 = held
+    uint32_t modifiers;
+} kbd_shared_t;
+
+#define KBD_NO_SEQ 0xFFFFFFFFu // Key press that put nothing in the getchar buffer
 
 void kbd_handler(regs_t *r);
 void kbd_install(void);
 int kbd_available(void);
 char kbd_getchar(void);
+void kbd_discard(uint32_t seq);
+int kbd_read_events(kbd_event_t* out, int max);
+void kbd_flush_events(void);
+const kbd_shared_t* kbd_shared_state(void);
 void kbd_readline(char *buf, int max_len);
@@ -0,0 +1,112 @@
+#include "klog.h"
+#include "serial.h"
+#include <stdint.h>
+
+// Bounded MPSC ring (sequence per slot): writers claim a slot with one CAS and
+// publish it by bumping its sequence, the serial drain is the only reader.
+// A full ring drops the message, logging never waits.
+typedef struct {
+    volatile uint32_t seq;
+    uint32_t len;
+    char data[KLOG_CHUNK];
+} klog_slot_t;
+
+static klog_slot_t ring[KLOG_SLOTS];
+static volatile uint32_t tail = 0; // Next slot to claim
+static uint32_t head = 0;          // Next slot to drain
+static uint32_t head_pos = 0;      // Bytes already drained from ring[head]
+static volatile uint32_t dropped = 0;
+static int inited = 0;
+
+static void klog_init(void) {
+    for (uint32_t i = 0; i < KLOG_SLOTS; i++)
+        ring[i].seq = i;
+    inited = 1;
+}
+
+static int klog_push_chunk(const char* s, uint32_t len) {
+    uint32_t pos = tail;
+    klog_slot_t* slot;
+
+    for (;;) {
+        slot = &ring[pos & (KLOG_SLOTS - 1)];
+        int32_t diff = (int32_t)(slot->seq - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&tail, &pos, pos + 1, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+                break;
+            // pos was reloaded by the failed CAS
+        } else if (diff < 0) {
+            return -1; // Full
+        } else {
+            pos = tail;
+        }
+    }
+
+    for (uint32_t i = 0; i < len; i++)
+        slot->data[i] = s[i];
+    slot->len = len;
+
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void klog_write(const char* s, uint32_t len) {
+    if (!inited)
+        klog_init();
+
+    while (len > 0) {
+        uint32_t n = (len > KLOG_CHUNK) ? KLOG_CHUNK : len;
+
+        if (klog_push_chunk(s, n) != 0) {
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        s += n;
+        len -= n;
+    }
+
+    serial_kick();
+}
+
+void klog(const char* s) {
+    uint32_t len = 0;
+
+    while (s[len])
+        len++;
+    klog_write(s, len);
+}
+
+// Single consumer only (serial IRQ or the synchronous panic drain)
+int klog_pop(char* c) {
+    if (!inited)
+        return 0;
+
+    klog_slot_t* slot = &ring[head & (KLOG_SLOTS - 1)];
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != head + 1)
+        return 0;
+
+    *c = slot->data[head_pos++];
+
+    if (head_pos == slot->len) {
+        head_pos = 0;
+        __atomic_store_n(&slot->seq, head + KLOG_SLOTS, __ATOMIC_RELEASE);
+        head++;
+    }
+
+    return 1;
+}
+
+int klog_pending(void) {
+    if (!inited)
+        return 0;
+
+    return __atomic_load_n(&ring[head & (KLOG_SLOTS - 1)].seq, __ATOMIC_ACQUIRE) == head + 1;
+}
+
+uint32_t klog_dropped(void) {
+    return dropped;
+}
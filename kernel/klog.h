@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+
+#define KLOG_SLOTS 256 // Power of two
+#define KLOG_CHUNK 56  // Bytes per slot, longer messages span several slots
+
+void klog(const char* s);
+void klog_write(const char* s, uint32_t len);
+int klog_pop(char* c);
+int klog_pending(void);
+uint32_t klog_dropped(void);
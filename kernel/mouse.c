@@ -3,6 +3,9 @@
 #include "irq.h"
 #include "gfx.h"
 #include "console.h"
+#include "event.h"
+#include "softirq.h"
+#include "cpu.h"
 #include <stdint.h>
 
 #define PS2_CMD      0x64
@@ -13,8 +16,16 @@
 #define ST_IBF  0x02  // Input buffer full
 #define ST_AUX  0x20  // 1 = data from mouse
 
+#define MOUSE_RATE 200 // Samples per second
+
 static volatile int mx = 0, my = 0;
 static volatile unsigned mbtn = 0;
+static int packet_size = 3; // 4 once IntelliMouse mode is on
+
+// Filled by the IRQ, drained by SYSCALL_MOUSE_GET with interrupts off
+static mouse_event_t mouse_events[MOUSE_EVENTS];
+static volatile uint32_t mev_head = 0;
+static volatile uint32_t mev_tail = 0;
 static int scr_w = 640, scr_h = 480;
 static int cursor_visible = 1;
 static int painter_enabled = 0;
@@ -42,9 +53,6 @@ static const uint8_t cursor_mask[CUR_H][CUR_W] = {
     {1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1}
 };
 
-static uint32_t saved_bg[CUR_W * CUR_H]; // RGB
-static int last_x = -10000, last_y = -10000;
-static int have_saved = 0;
 static volatile int redraw_needed = 1;
 
 static void wait_write(void) {
@@ -71,63 +79,117 @@ static uint8_t mouse_read(void){
 
 static inline int clamp(int v, int lo, int hi){ return v<lo?lo:(v>hi?hi:v); }
 
-static void cursor_erase(void){
-    if (!have_saved) return;
+// The sprite lives on gfx's cursor plane, moving it only rewrites its spans
+void mouse_on_timer_tick(void){
+    if (!painter_enabled || !redraw_needed) return;
+    redraw_needed = 0;
 
-    int w = (last_x + CUR_W > scr_w) ? (scr_w - last_x) : CUR_W;
-    int h = (last_y + CUR_H > scr_h) ? (scr_h - last_y) : CUR_H;
+    gfx_cursor_move(mx, my);
+}
 
-    if (w<=0 || h<=0) return;
+void mouse_set_visible(int visible){
+    cursor_visible = visible ? 1 : 0;
+    if (painter_enabled)
+        gfx_cursor_show(cursor_visible);
+}
 
-    for (int j=0; j<h; ++j)
-        for (int i=0; i<w; ++i)
-            gfx_putpixel(last_x+i, last_y+j, saved_bg[j*CUR_W+i]);
+void mouse_get(int* x, int* y, unsigned* buttons){
+    if (x) *x = mx;
+    if (y) *y = my;
+    if (buttons) *buttons = mbtn;
 }
 
-static void cursor_draw_at(int x, int y){
-    int w = (x + CUR_W > scr_w) ? (scr_w - x) : CUR_W;
-    int h = (y + CUR_H > scr_h) ? (scr_h - y) : CUR_H;
-    if (w<=0 || h<=0) { have_saved = 0; return; }
+static void mouse_queue(uint16_t type, int dx, int dy, int wheel) {
+    uint64_t now = rdtsc();
 
-    for (int j=0; j<h; ++j)
-        for (int i=0; i<w; ++i)
-            saved_bg[j*CUR_W+i] = gfx_get_pixel(x+i, y+j);
+    // Only the latest position matters, merge into an unread move with the same buttons
+    if (type == MOUSE_EV_MOVE && mev_tail != mev_head) {
+        mouse_event_t* last = &mouse_events[(mev_tail - 1) & MOUSE_EVENTS_MASK];
 
-    for (int j=0; j<h; ++j)
-        for (int i=0; i<w; ++i)
-            if (cursor_mask[j][i]) gfx_putpixel(x+i, y+j, 0x00FFFFFF);
+        if (last->type == MOUSE_EV_MOVE && last->buttons == mbtn) {
+            last->x = (int16_t)mx;
+            last->y = (int16_t)my;
+            last->dx += (int16_t)dx;
+            last->dy += (int16_t)dy;
+            last->tsc = now;
+            return;
+        }
+    }
 
-    have_saved = 1;
-    last_x = x; last_y = y;
+    if (mev_tail - mev_head >= MOUSE_EVENTS)
+        return; // Full, drop the newest
+
+    mouse_event_t* e = &mouse_events[mev_tail & MOUSE_EVENTS_MASK];
+    e->type = type;
+    e->buttons = (uint16_t)mbtn;
+    e->x = (int16_t)mx;
+    e->y = (int16_t)my;
+    e->dx = (int16_t)dx;
+    e->dy = (int16_t)dy;
+    e->wheel = (int16_t)wheel;
+    e->reserved = 0;
+    e->tsc = now;
+    mev_tail++;
 }
 
-void mouse_on_timer_tick(void){
-    if (!painter_enabled || !cursor_visible) return;
+int mouse_read_events(mouse_event_t* out, int max) {
+    uint32_t flags;
+    int n = 0;
 
-    static unsigned ctr = 0;
-    if (++ctr % 9 == 0) redraw_needed = 1;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
 
-    if (!redraw_needed) return;
-    redraw_needed = 0;
+    while (n < max && mev_head != mev_tail)
+        out[n++] = mouse_events[mev_head++ & MOUSE_EVENTS_MASK];
 
-    cursor_erase();
-    cursor_draw_at(mx, my);
-}
+    if (flags & 0x200)
+        asm volatile("sti" : : : "memory");
 
-void mouse_set_visible(int visible){
-    cursor_visible = visible ? 1 : 0;
-    redraw_needed = 1;
+    return n;
 }
 
-void mouse_get(int* x, int* y, unsigned* buttons){
-    if (x) *x = mx;
-    if (y) *y = my;
-    if (buttons) *buttons = mbtn;
+void mouse_flush_events(void) {
+    mev_head = mev_tail;
 }
 
-static uint8_t pkt[3];
+static uint8_t pkt[4];
 static int    idx = 0;
 
+static void mouse_packet(void) {
+    // Overflowed deltas are garbage
+    if (pkt[0] & 0xC0)
+        return;
+
+    int dx = (int8_t)pkt[1];
+    int dy = -(int8_t)pkt[2]; // PS/2: inverted y
+    int dz = (packet_size == 4) ? (int8_t)pkt[3] : 0;
+
+    mx = clamp(mx + dx, 0, scr_w - 1);
+    my = clamp(my + dy, 0, scr_h - 1);
+
+    unsigned prev = mbtn;
+    mbtn = ((pkt[0] & 1) ? 1 : 0)
+         | ((pkt[0] & 2) ? 2 : 0)
+         | ((pkt[0] & 4) ? 4 : 0);
+
+    if (dx || dy) {
+        mouse_queue(MOUSE_EV_MOVE, dx, dy, 0);
+        event_post(EV_MOUSE_MOVE, 0, mx, my, mbtn);
+    }
+    if (mbtn != prev) {
+        mouse_queue(MOUSE_EV_BUTTON, 0, 0, 0);
+        event_post(EV_MOUSE_BUTTON, (uint16_t)(mbtn ^ prev), mx, my, mbtn);
+    }
+    if (dz) {
+        mouse_queue(MOUSE_EV_WHEEL, 0, 0, dz);
+        event_post(EV_MOUSE_WHEEL, 0, mx, my, (uint32_t)dz);
+    }
+
+    if (dx || dy) {
+        redraw_needed = 1;
+        raise_softirq(SOFTIRQ_CURSOR);
+    }
+}
+
 static void mouse_irq(regs_t* r){
     (void)r;
     for (;;) {
@@ -139,30 +201,31 @@ static void mouse_irq(regs_t* r){
             continue;
         }
 
+        // Bit 3 of the first byte is always set, resync on anything else
         if (idx == 0 && !(b & 0x08)) {
             idx = 0;
             continue;
         }
 
         pkt[idx++] = b;
-        if (idx == 3) {
+        if (idx == packet_size) {
             idx = 0;
-
-            int dx = (int8_t)pkt[1];
-            int dy = -(int8_t)pkt[2]; // PS/2: inverted y
-
-            mx = clamp(mx + dx, 0, scr_w - 1);
-            my = clamp(my + dy, 0, scr_h - 1);
-
-            mbtn = ((pkt[0] & 1) ? 1 : 0)
-                 | ((pkt[0] & 2) ? 2 : 0)
-                 | ((pkt[0] & 4) ? 4 : 0);
-
-            redraw_needed = 1;
+            mouse_packet();
         }
     }
 }
 
+// Returns 0 if the mouse ACKed
+static int mouse_cmd(uint8_t val) {
+    mouse_write(val);
+    return (mouse_read() == 0xFA) ? 0 : -1;
+}
+
+static void mouse_set_rate(uint8_t rate) {
+    mouse_cmd(0xF3);
+    mouse_cmd(rate);
+}
+
 void mouse_init(int gfx_enabled){
     const gfx_info_t* gi = gfx_info();
 
@@ -188,15 +251,29 @@ void mouse_init(int gfx_enabled){
     wait_write(); outb(PS2_CMD, 0x60);
     wait_write(); outb(PS2_DATA, status);
 
-    mouse_write(0xF6); (void)mouse_read(); // ACK
-    mouse_write(0xF4); (void)mouse_read(); // ACK
+    mouse_cmd(0xF6); // Defaults
+
+    // IntelliMouse knock: rates 200, 100, 80 switch it to ID 3 with a wheel byte
+    mouse_set_rate(200);
+    mouse_set_rate(100);
+    mouse_set_rate(80);
+    mouse_cmd(0xF2);
+    packet_size = (mouse_read() == 3) ? 4 : 3;
+
+    mouse_set_rate(MOUSE_RATE);
+    mouse_cmd(0xF4); // Start streaming
 
     mx = scr_w/2; 
     my = scr_h/2; 
     mbtn = 0;
-    last_x = last_y = -10000; 
-    have_saved = 0; 
     redraw_needed = 1;
+    idx = 0;
+
+    if (painter_enabled) {
+        gfx_cursor_set_shape(&cursor_mask[0][0], CUR_W, CUR_H, 0x00FFFFFF);
+        gfx_cursor_move(mx, my);
+        gfx_cursor_show(cursor_visible);
+    }
 
     // Hook IRQ12
     register_interrupt_handler(12, mouse_irq);
@@ -1,7 +1,28 @@
 #pragma once
 #include <stdint.h>
 
+#define MOUSE_EVENTS 64 // Power of two
+#define MOUSE_EVENTS_MASK (MOUSE_EVENTS - 1)
+
+enum {
+    MOUSE_EV_MOVE = 1,
+    MOUSE_EV_BUTTON = 2,
+    MOUSE_EV_WHEEL = 3,
+};
+
+typedef struct {
+    uint16_t type;
+    uint16_t buttons;  // bit0=L, bit1=R, bit2=M after the event
+    int16_t x, y;      // Position after the event
+    int16_t dx, dy;    // Motion folded into this event
+    int16_t wheel;     // Notches, negative = away from the user
+    uint16_t reserved;
+    uint64_t tsc;
+} mouse_event_t;
+
 void mouse_init(int gfx_enabled);
 void mouse_on_timer_tick(void);
 void mouse_get(int* x, int* y, unsigned* buttons);
 void mouse_set_visible(int visible);
+int mouse_read_events(mouse_event_t* out, int max);
+void mouse_flush_events(void);
@@ -38,3 +38,15 @@ void pic_remap(uint8_t offset1, uint8_t offset2) {
 	outb(PIC1_DATA, a1);
 	outb(PIC2_DATA, a2);
 }
+
+void pic_set_mask(uint8_t irq, int masked) {
+	uint16_t port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
+	uint8_t bit = (uint8_t)(1 << (irq & 7));
+	uint8_t mask = inb(port);
+
+	outb(port, masked ? (mask | bit) : (mask & ~bit));
+
+	// Slave lines only get through when the cascade (IRQ2) is open
+	if (irq >= 8 && !masked)
+		outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << 2));
+}
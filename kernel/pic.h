@@ -3,3 +3,4 @@
 
 void pic_send_eoi(uint8_t irq);
 void pic_remap(uint8_t offset1, uint8_t offset2);
+void pic_set_mask(uint8_t irq, int masked);
@@ -0,0 +1,143 @@
+#include "prof.h"
+#include "../lib/string.h"
+#include <stdint.h>
+
+// Everything runs on the boot stack that kernel_entry sets up at 0x200000
+#define PROF_STACK_LO 0x00100000
+#define PROF_STACK_HI 0x00200000
+#define PROF_MAX_DEPTH 8
+
+typedef struct {
+    uint32_t eip; // 0 = free slot
+    uint32_t app;
+    uint32_t self;
+    uint32_t total;
+} prof_slot_t;
+
+static prof_slot_t slots[PROF_SLOTS];
+static char app_names[PROF_MAX_APPS][PROF_APP_NAME];
+static int app_count = 0;
+static uint32_t cur_app = 0;
+
+static volatile int running = 0;
+static uint32_t prof_flags = 0;
+static uint32_t samples = 0;
+
+// Open addressing, returns NULL once the table is full
+static prof_slot_t* prof_slot(uint32_t eip) {
+    uint32_t h = ((eip * 2654435761u) ^ (cur_app * 97u)) & (PROF_SLOTS - 1);
+
+    for (int probe = 0; probe < 32; probe++) {
+        prof_slot_t* s = &slots[(h + probe) & (PROF_SLOTS - 1)];
+
+        if (s->eip == eip && s->app == cur_app)
+            return s;
+        if (s->eip == 0) {
+            s->eip = eip;
+            s->app = cur_app;
+            return s;
+        }
+    }
+
+    return 0;
+}
+
+static void prof_walk(uint32_t ebp) {
+    for (int depth = 0; depth < PROF_MAX_DEPTH; depth++) {
+        if (ebp < PROF_STACK_LO || ebp >= PROF_STACK_HI - 8 || (ebp & 3))
+            return;
+
+        const uint32_t* frame = (const uint32_t*)ebp;
+        uint32_t ret = frame[1];
+
+        if (!ret)
+            return;
+
+        // ret - 1 lands on the call itself, so calls at the end of a function resolve right
+        prof_slot_t* s = prof_slot(ret - 1);
+        if (s)
+            s->total++;
+
+        if (frame[0] <= ebp) // Frames only ever move up the stack
+            return;
+        ebp = frame[0];
+    }
+}
+
+void prof_tick(const regs_t* r) {
+    if (!running)
+        return;
+
+    samples++;
+
+    prof_slot_t* s = prof_slot(r->eip);
+    if (s) {
+        s->self++;
+        s->total++;
+    }
+
+    if (prof_flags & PROF_F_CALLGRAPH)
+        prof_walk(r->ebp);
+}
+
+void prof_set_app(const char* name) {
+    for (int i = 0; i < app_count; i++) {
+        if (!strncmp(app_names[i], name, PROF_APP_NAME - 1)) {
+            cur_app = (uint32_t)i;
+            return;
+        }
+    }
+
+    // Table full: keep charging the last app rather than losing samples
+    if (app_count == PROF_MAX_APPS) {
+        cur_app = PROF_MAX_APPS - 1;
+        return;
+    }
+
+    int n = 0;
+    for (; n < PROF_APP_NAME - 1 && name[n]; n++)
+        app_names[app_count][n] = name[n];
+    app_names[app_count][n] = 0;
+
+    cur_app = (uint32_t)app_count++;
+}
+
+void prof_reset(void) {
+    running = 0;
+    memset(slots, 0, sizeof(slots));
+    samples = 0;
+}
+
+void prof_start(uint32_t flags) {
+    prof_reset();
+    prof_flags = flags;
+    running = 1;
+}
+
+uint32_t prof_stop(void) {
+    running = 0;
+
+    return samples;
+}
+
+int prof_dump(prof_sample_t* out, int max) {
+    int n = 0;
+
+    if (!out || max <= 0)
+        return -1;
+
+    for (int i = 0; i < PROF_SLOTS && n < max; i++) {
+        const prof_slot_t* s = &slots[i];
+
+        if (!s->eip)
+            continue;
+
+        out[n].eip = s->eip;
+        out[n].self = s->self;
+        out[n].total = s->total;
+        memcpy(out[n].app, app_names[s->app], PROF_APP_NAME);
+        n++;
+    }
+
+    return n;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "isr.h"
+#include <stdint.h>
+
+#define PROF_SLOTS 2048 // Distinct (eip, app) pairs kept, power of two
+#define PROF_MAX_APPS 8
+#define PROF_APP_NAME 16
+
+#define PROF_F_CALLGRAPH 0x01 // Walk the frame pointer chain on each sample
+
+typedef struct {
+    uint32_t eip;
+    uint32_t self;  // Samples with eip on top of the stack
+    uint32_t total; // Samples with eip anywhere on the walked stack
+    char app[PROF_APP_NAME]; // App running when sampled, kernel code included
+} prof_sample_t;
+
+void prof_start(uint32_t flags);
+uint32_t prof_stop(void);
+void prof_reset(void);
+void prof_tick(const regs_t* r);
+void prof_set_app(const char* name);
+int prof_dump(prof_sample_t* out, int max);
@@ -0,0 +1,222 @@
+#include "sched.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "../lib/string.h"
+#include <stdint.h>
+
+#define SCHED_QUEUE_MASK (SCHED_QUEUE_SIZE - 1)
+
+typedef struct {
+    sched_fn_t fn;
+    void* arg;
+    sched_group_t* group; // Optional, signalled when fn returns
+} sched_item_t;
+
+// head == tail means empty. The owner pushes and pops at tail (LIFO, the
+// data is still warm in its cache); thieves take from head (FIFO, oldest).
+typedef struct {
+    spinlock_t lock;
+    uint32_t head;
+    uint32_t tail;
+    sched_item_t items[SCHED_QUEUE_SIZE];
+} __attribute__((aligned(64))) run_queue_t;
+
+static run_queue_t queues[SMP_MAX_CPUS];
+
+void sched_init(void) {
+    memset(queues, 0, sizeof(queues));
+}
+
+static int queue_push(run_queue_t* q, const sched_item_t* it) {
+    uint32_t flags = spin_lock_irqsave(&q->lock);
+    int ok = (q->tail - q->head) < SCHED_QUEUE_SIZE;
+
+    if (ok) {
+        q->items[q->tail & SCHED_QUEUE_MASK] = *it;
+        q->tail++;
+    }
+
+    spin_unlock_irqrestore(&q->lock, flags);
+    return ok;
+}
+
+static int queue_pop(run_queue_t* q, int steal, sched_item_t* out) {
+    if (q->head == q->tail) // Racy peek, saves taking the lock on empty queues
+        return 0;
+
+    uint32_t flags = spin_lock_irqsave(&q->lock);
+    int ok = q->head != q->tail;
+
+    if (ok) {
+        if (steal)
+            *out = q->items[q->head++ & SCHED_QUEUE_MASK];
+        else
+            *out = q->items[--q->tail & SCHED_QUEUE_MASK];
+    }
+
+    spin_unlock_irqrestore(&q->lock, flags);
+    return ok;
+}
+
+static void wake_idle(int except) {
+    int n = smp_cpu_count();
+
+    for (int i = 0; i < n; i++) {
+        percpu_t* c = smp_cpu(i);
+        if (i != except && c->online && c->idle)
+            smp_send_wake(i);
+    }
+}
+
+static void run_item(percpu_t* c, const sched_item_t* it) {
+    it->fn(it->arg);
+    c->jobs_run++;
+
+    if (it->group)
+        __atomic_sub_fetch(&it->group->pending, 1, __ATOMIC_RELEASE);
+}
+
+static void submit_item(const sched_item_t* it) {
+    int n = smp_cpu_count();
+    int me = smp_cpu_index();
+
+    for (int k = 0; k < n; k++) {
+        if (queue_push(&queues[(me + k) % n], it)) {
+            // The unlock is a plain store: without a full barrier the idle
+            // loads below can pass the new tail, and a CPU going idle right
+            // now would both miss the item and get no IPI
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            wake_idle(me);
+            return;
+        }
+    }
+
+    // Every queue is full, just do it here
+    run_item(smp_this_cpu(), it);
+}
+
+void sched_submit(sched_fn_t fn, void* arg) {
+    sched_item_t it = { fn, arg, 0 };
+    submit_item(&it);
+}
+
+void sched_group_submit(sched_group_t* g, sched_fn_t fn, void* arg) {
+    sched_item_t it = { fn, arg, g };
+
+    __atomic_add_fetch(&g->pending, 1, __ATOMIC_RELAXED);
+    submit_item(&it);
+}
+
+// The waiter works the queues too, so a group finishes even with no other CPU
+void sched_group_wait(sched_group_t* g) {
+    int me = smp_cpu_index();
+
+    while (__atomic_load_n(&g->pending, __ATOMIC_ACQUIRE) != 0) {
+        if (!sched_run_one(me))
+            asm volatile("pause");
+    }
+}
+
+typedef struct {
+    sched_range_fn_t fn;
+    void* arg;
+    int begin, end;
+} sched_range_t;
+
+static void range_thunk(void* p) {
+    sched_range_t* r = (sched_range_t*)p;
+    r->fn(r->arg, r->begin, r->end);
+}
+
+// Splits [0, n) into chunks that are multiples of grain, two per CPU so a
+// slow CPU doesn't hold up the batch, and returns once all of them ran
+void sched_parallel_for(int n, int grain, sched_range_fn_t fn, void* arg) {
+    int cpus = smp_cpu_count();
+
+    if (cpus == 1 || n <= grain) {
+        fn(arg, 0, n);
+        return;
+    }
+
+    sched_range_t parts[SMP_MAX_CPUS * 2];
+    sched_group_t g = { 0 };
+    int units = (n + grain - 1) / grain;
+    int count = cpus * 2;
+
+    if (count > units)
+        count = units;
+
+    for (int i = 0; i < count; i++) {
+        parts[i].fn = fn;
+        parts[i].arg = arg;
+        parts[i].begin = (units * i / count) * grain;
+        parts[i].end = (units * (i + 1) / count) * grain;
+        if (parts[i].end > n)
+            parts[i].end = n;
+    }
+
+    // Keep the first chunk for ourselves, others can start on theirs meanwhile
+    for (int i = 1; i < count; i++)
+        sched_group_submit(&g, range_thunk, &parts[i]);
+
+    range_thunk(&parts[0]);
+    sched_group_wait(&g);
+}
+
+// Takes one item from this CPU's queue, or steals one. Returns 0 if there was nothing.
+static int sched_take(int cpu, sched_item_t* it) {
+    int n = smp_cpu_count();
+
+    if (queue_pop(&queues[cpu], 0, it))
+        return 1;
+
+    for (int k = 1; k < n; k++) {
+        if (queue_pop(&queues[(cpu + k) % n], 1, it)) {
+            smp_cpu(cpu)->jobs_stolen++;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Runs one item from this CPU's queue, or steals one. Returns 0 if there was nothing.
+int sched_run_one(int cpu) {
+    sched_item_t it;
+
+    if (!sched_take(cpu, &it))
+        return 0;
+
+    run_item(smp_cpu(cpu), &it);
+    return 1;
+}
+
+void sched_idle_loop(int cpu) {
+    percpu_t* c = smp_cpu(cpu);
+
+    asm volatile("sti");
+
+    for (;;) {
+        while (sched_run_one(cpu))
+            ;
+
+        // Publish idle before the last check; the submitter fences between
+        // its push and reading idle, so either it sends the IPI or we see
+        // its item. Only the check runs with IF=0, sti;hlt closes the gap.
+        sched_item_t it;
+
+        c->idle = 1;
+        asm volatile("cli");
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        if (!sched_take(cpu, &it)) {
+            asm volatile("sti; hlt" : : : "memory");
+            c->idle = 0;
+            continue;
+        }
+
+        asm volatile("sti");
+        c->idle = 0;
+        run_item(c, &it);
+    }
+}
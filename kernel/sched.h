@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+
+#define SCHED_QUEUE_SIZE 64 // Per CPU, power of two
+
+// A unit of work. Runs to completion on whichever CPU picks it up.
+typedef void (*sched_fn_t)(void* arg);
+typedef void (*sched_range_fn_t)(void* arg, int begin, int end);
+
+// Completion barrier for a batch of items
+typedef struct {
+    volatile uint32_t pending;
+} sched_group_t;
+
+void sched_init(void);
+void sched_submit(sched_fn_t fn, void* arg);
+void sched_group_submit(sched_group_t* g, sched_fn_t fn, void* arg);
+void sched_group_wait(sched_group_t* g);
+void sched_parallel_for(int n, int grain, sched_range_fn_t fn, void* arg);
+int sched_run_one(int cpu);
+void sched_idle_loop(int cpu);
@@ -0,0 +1,107 @@
+#include "serial.h"
+#include "klog.h"
+#include "io.h"
+#include "irq.h"
+#include <stdint.h>
+
+// 16550 UART on COM1, drains the klog ring from its THRE interrupt
+#define COM1      0x3F8
+#define UART_DATA (COM1 + 0) // DLAB=0: THR/RBR, DLAB=1: divisor low
+#define UART_IER  (COM1 + 1) // DLAB=1: divisor high
+#define UART_IIR  (COM1 + 2) // Read
+#define UART_FCR  (COM1 + 2) // Write
+#define UART_LCR  (COM1 + 3)
+#define UART_MCR  (COM1 + 4)
+#define UART_LSR  (COM1 + 5)
+
+#define IER_THRE  0x02
+#define LCR_DLAB  0x80
+#define LCR_8N1   0x03
+#define FCR_ON    0xC7 // Enable + clear both FIFOs, 14-byte RX trigger
+#define MCR_LOOP  0x10
+#define MCR_IRQ   0x0B // DTR | RTS | OUT2 (OUT2 gates the IRQ line)
+#define LSR_THRE  0x20
+
+#define UART_FIFO 16 // TX FIFO depth, refilled in one go per interrupt
+
+static int present = 0;
+static volatile int tx_active = 0;
+
+static void serial_fill_fifo(void) {
+    char c;
+
+    for (int i = 0; i < UART_FIFO && klog_pop(&c); i++)
+        outb(UART_DATA, (uint8_t)c);
+}
+
+static void serial_irq(regs_t* r) {
+    (void)r;
+
+    (void)inb(UART_IIR); // Ack
+
+    if (!(inb(UART_LSR) & LSR_THRE))
+        return;
+
+    if (klog_pending()) {
+        serial_fill_fifo();
+        return;
+    }
+
+    // Nothing left: go quiet until the next serial_kick, then re-check for
+    // a writer that slipped in before tx_active dropped
+    tx_active = 0;
+    outb(UART_IER, 0);
+
+    if (klog_pending()) {
+        tx_active = 1;
+        outb(UART_IER, IER_THRE);
+    }
+}
+
+int serial_init(void) {
+    outb(UART_IER, 0);
+    outb(UART_LCR, LCR_DLAB);
+    outb(UART_DATA, 1); // 115200 baud
+    outb(UART_IER, 0);
+    outb(UART_LCR, LCR_8N1);
+    outb(UART_FCR, FCR_ON);
+
+    // Loopback self test, no UART means no serial output at all
+    outb(UART_MCR, MCR_LOOP | MCR_IRQ);
+    outb(UART_DATA, 0xAE);
+    if (inb(UART_DATA) != 0xAE)
+        return -1;
+
+    outb(UART_MCR, MCR_IRQ);
+    present = 1;
+
+    register_interrupt_handler(4, serial_irq);
+
+    // Anything logged before this point is already waiting in the ring
+    serial_kick();
+
+    return 0;
+}
+
+// Called by writers: arms THRE, which fires right away on an idle transmitter
+void serial_kick(void) {
+    if (!present || tx_active)
+        return;
+
+    tx_active = 1;
+    outb(UART_IER, IER_THRE);
+}
+
+// Polled drain for paths that will never see another interrupt (panics)
+void serial_flush_sync(void) {
+    char c;
+
+    if (!present)
+        return;
+
+    while (klog_pop(&c)) {
+        while (!(inb(UART_LSR) & LSR_THRE))
+            ;
+        outb(UART_DATA, (uint8_t)c);
+    }
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+
+int serial_init(void);
+void serial_kick(void);
+void serial_flush_sync(void);
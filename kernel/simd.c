@@ -0,0 +1,218 @@
+#include "simd.h"
+#include "cpu.h"
+#include "fpu.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*convert_fn_t)(uint32_t*, const uint32_t*, size_t);
+
+static int level = SIMD_NONE;
+static convert_fn_t convert_best;
+
+// Byte order per pixel: memory B G R X -> R G B 0
+static const uint8_t shuf_bgrx[32] __attribute__((aligned(32))) = {
+    2, 1, 0, 0x80,  6, 5, 4, 0x80,  10, 9, 8, 0x80,  14, 13, 12, 0x80,
+    2, 1, 0, 0x80,  6, 5, 4, 0x80,  10, 9, 8, 0x80,  14, 13, 12, 0x80,
+};
+static const uint32_t mask_lo[4] __attribute__((aligned(16))) = { 0xFF, 0xFF, 0xFF, 0xFF };
+static const uint32_t mask_g[4]  __attribute__((aligned(16))) = { 0xFF00, 0xFF00, 0xFF00, 0xFF00 };
+static const uint32_t mask_hi[4] __attribute__((aligned(16))) = { 0xFF0000, 0xFF0000, 0xFF0000, 0xFF0000 };
+
+static inline uint32_t swap_rb(uint32_t rgb) {
+    return ((rgb & 0x000000FF) << 16) | (rgb & 0x0000FF00) | ((rgb & 0x00FF0000) >> 16);
+}
+
+static void convert_scalar(uint32_t* dst, const uint32_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = swap_rb(src[i]);
+}
+
+__attribute__((target("sse2")))
+static void convert_sse2(uint32_t* dst, const uint32_t* src, size_t n) {
+    size_t blocks = n / 4;
+
+    if (blocks) {
+        asm volatile(
+            "movdqa (%3), %%xmm5\n"
+            "movdqa (%4), %%xmm6\n"
+            "movdqa (%5), %%xmm7\n"
+            "1:\n"
+            "movdqu (%1), %%xmm0\n"
+            "movdqa %%xmm0, %%xmm1\n"
+            "movdqa %%xmm0, %%xmm2\n"
+            "pand %%xmm6, %%xmm0\n"  // G stays
+            "pslld $16, %%xmm1\n"
+            "pand %%xmm7, %%xmm1\n"  // B -> bits 16-23
+            "psrld $16, %%xmm2\n"
+            "pand %%xmm5, %%xmm2\n"  // R -> bits 0-7
+            "por %%xmm1, %%xmm0\n"
+            "por %%xmm2, %%xmm0\n"
+            "movdqu %%xmm0, (%0)\n"
+            "add $16, %1\n"
+            "add $16, %0\n"
+            "dec %2\n"
+            "jnz 1b\n"
+            : "+r"(dst), "+r"(src), "+r"(blocks)
+            : "r"(mask_lo), "r"(mask_g), "r"(mask_hi)
+            : "xmm0", "xmm1", "xmm2", "xmm5", "xmm6", "xmm7", "memory", "cc");
+    }
+
+    convert_scalar(dst, src, n & 3);
+}
+
+__attribute__((target("ssse3")))
+static void convert_ssse3(uint32_t* dst, const uint32_t* src, size_t n) {
+    size_t blocks = n / 8;
+
+    if (blocks) {
+        asm volatile(
+            "movdqa (%3), %%xmm7\n"
+            "1:\n"
+            "movdqu (%1), %%xmm0\n"
+            "movdqu 16(%1), %%xmm1\n"
+            "pshufb %%xmm7, %%xmm0\n"
+            "pshufb %%xmm7, %%xmm1\n"
+            "movdqu %%xmm0, (%0)\n"
+            "movdqu %%xmm1, 16(%0)\n"
+            "add $32, %1\n"
+            "add $32, %0\n"
+            "dec %2\n"
+            "jnz 1b\n"
+            : "+r"(dst), "+r"(src), "+r"(blocks)
+            : "r"(shuf_bgrx)
+            : "xmm0", "xmm1", "xmm7", "memory", "cc");
+    }
+
+    convert_scalar(dst, src, n & 7);
+}
+
+__attribute__((target("avx2")))
+static void convert_avx2(uint32_t* dst, const uint32_t* src, size_t n) {
+    size_t blocks = n / 16;
+
+    if (blocks) {
+        asm volatile(
+            "vmovdqa (%3), %%ymm7\n"
+            "1:\n"
+            "vmovdqu (%1), %%ymm0\n"
+            "vmovdqu 32(%1), %%ymm1\n"
+            "vpshufb %%ymm7, %%ymm0, %%ymm0\n"
+            "vpshufb %%ymm7, %%ymm1, %%ymm1\n"
+            "vmovdqu %%ymm0, (%0)\n"
+            "vmovdqu %%ymm1, 32(%0)\n"
+            "add $64, %1\n"
+            "add $64, %0\n"
+            "dec %2\n"
+            "jnz 1b\n"
+            "vzeroupper\n"
+            : "+r"(dst), "+r"(src), "+r"(blocks)
+            : "r"(shuf_bgrx)
+            : "xmm0", "xmm1", "xmm7", "memory", "cc");
+    }
+
+    convert_scalar(dst, src, n & 15);
+}
+
+__attribute__((target("sse2")))
+static void copy_nt_sse2(uint32_t* dst, const uint32_t* src, size_t n) {
+    // movntdq wants a 16-byte aligned destination
+    while (n && ((uintptr_t)dst & 15)) {
+        *dst++ = *src++;
+        n--;
+    }
+
+    size_t blocks = n / 16;
+
+    if (blocks) {
+        asm volatile(
+            "1:\n"
+            "movdqu (%1), %%xmm0\n"
+            "movdqu 16(%1), %%xmm1\n"
+            "movdqu 32(%1), %%xmm2\n"
+            "movdqu 48(%1), %%xmm3\n"
+            "movntdq %%xmm0, (%0)\n"
+            "movntdq %%xmm1, 16(%0)\n"
+            "movntdq %%xmm2, 32(%0)\n"
+            "movntdq %%xmm3, 48(%0)\n"
+            "add $64, %1\n"
+            "add $64, %0\n"
+            "dec %2\n"
+            "jnz 1b\n"
+            "sfence\n"
+            : "+r"(dst), "+r"(src), "+r"(blocks)
+            :
+            : "xmm0", "xmm1", "xmm2", "xmm3", "memory", "cc");
+    }
+
+    for (n &= 15; n; n--)
+        *dst++ = *src++;
+}
+
+static void copy_scalar(uint32_t* dst, const uint32_t* src, size_t n) {
+    asm volatile("cld; rep movsl"
+                 : "+D"(dst), "+S"(src), "+c"(n)
+                 :
+                 : "memory");
+}
+
+// fpu_init has already turned on whatever state the OS can save
+void simd_init(void) {
+    uint32_t a, b, c, d;
+    uint32_t max;
+    uint32_t f = fpu_features();
+
+    convert_best = convert_scalar;
+    cpuid(0, 0, &max, &b, &c, &d);
+    cpuid(1, 0, &a, &b, &c, &d);
+
+    if (!(f & FPU_F_SSE) || !(d & (1u << 26))) // SSE2
+        return;
+
+    level = SIMD_SSE2;
+    if (c & (1u << 9))
+        level = SIMD_SSSE3;
+
+    if ((f & FPU_F_AVX) && max >= 7) {
+        uint32_t b7;
+        cpuid(7, 0, &a, &b7, &c, &d);
+        if (b7 & (1u << 5))
+            level = SIMD_AVX2;
+    }
+
+    switch (level) {
+    case SIMD_AVX2:  convert_best = convert_avx2; break;
+    case SIMD_SSSE3: convert_best = convert_ssse3; break;
+    default:         convert_best = convert_sse2; break;
+    }
+}
+
+int simd_level(void) {
+    return level;
+}
+
+const char* simd_name(void) {
+    static const char* names[] = { "scalar", "SSE2", "SSSE3", "AVX2" };
+    return names[level];
+}
+
+void simd_rgb_to_bgrx(uint32_t* dst, const uint32_t* src, size_t n) {
+    if (level == SIMD_NONE) {
+        convert_scalar(dst, src, n);
+        return;
+    }
+
+    kernel_fpu_begin();
+    convert_best(dst, src, n);
+    kernel_fpu_end();
+}
+
+void simd_copy_nt(uint32_t* dst, const uint32_t* src, size_t n) {
+    if (level == SIMD_NONE) {
+        copy_scalar(dst, src, n);
+        return;
+    }
+
+    kernel_fpu_begin();
+    copy_nt_sse2(dst, src, n);
+    kernel_fpu_end();
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+    SIMD_NONE = 0,
+    SIMD_SSE2 = 1,
+    SIMD_SSSE3 = 2,
+    SIMD_AVX2 = 3,
+};
+
+void simd_init(void);
+int simd_level(void);
+const char* simd_name(void);
+
+// 0x00RRGGBB -> BGRX, n pixels
+void simd_rgb_to_bgrx(uint32_t* dst, const uint32_t* src, size_t n);
+// Streaming copy that bypasses the cache, for writes into the LFB
+void simd_copy_nt(uint32_t* dst, const uint32_t* src, size_t n);
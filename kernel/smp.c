@@ -0,0 +1,217 @@
+#include "smp.h"
+#include "acpi.h"
+#include "apic.h"
+#include "gdt.h"
+#include "idt.h"
+#include "sched.h"
+#include "fpu.h"
+#include "console.h"
+#include "../lib/string.h"
+#include "../lib/stdlib.h"
+#include <stdint.h>
+
+// Real-mode entry for the APs, SIPI vector = page number (0x07)
+#define SMP_TRAMPOLINE 0x7000
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+#define ICR_INIT      0x00004500 // INIT, level assert
+#define ICR_STARTUP   0x00004600
+#define ICR_FIXED     0x00004000 // Fixed delivery, level assert
+#define ICR_PENDING   0x00001000
+
+extern volatile unsigned int g_ticks;
+extern idt_ptr_t idt_ptr;
+extern void idt_flush(uint32_t);
+
+extern uint8_t smp_trampoline_start[], smp_trampoline_end[];
+extern uint8_t smp_tramp_stack[], smp_tramp_entry[];
+
+// Switches to protected mode with a throwaway flat GDT, then calls
+// smp_tramp_entry on smp_tramp_stack. Copied to SMP_TRAMPOLINE, so every
+// address is computed relative to it.
+asm(
+    ".code16\n"
+    ".global smp_trampoline_start, smp_trampoline_end\n"
+    ".global smp_tramp_stack, smp_tramp_entry\n"
+    "smp_trampoline_start:\n"
+    "    cli\n"
+    "    xor %ax, %ax\n"
+    "    mov %ax, %ds\n"
+    "    lgdtl " STR(SMP_TRAMPOLINE) " + (smp_tramp_gdtr - smp_trampoline_start)\n"
+    "    mov %cr0, %eax\n"
+    "    or $1, %eax\n"
+    "    mov %eax, %cr0\n"
+    "    ljmpl $0x08, $(" STR(SMP_TRAMPOLINE) " + (smp_tramp_pm - smp_trampoline_start))\n"
+    ".code32\n"
+    "smp_tramp_pm:\n"
+    "    mov $0x10, %ax\n"
+    "    mov %ax, %ds\n"
+    "    mov %ax, %es\n"
+    "    mov %ax, %fs\n"
+    "    mov %ax, %gs\n"
+    "    mov %ax, %ss\n"
+    "    mov " STR(SMP_TRAMPOLINE) " + (smp_tramp_stack - smp_trampoline_start), %esp\n"
+    "    call *" STR(SMP_TRAMPOLINE) " + (smp_tramp_entry - smp_trampoline_start)\n"
+    "1:  hlt\n"
+    "    jmp 1b\n"
+    ".align 8\n"
+    "smp_tramp_gdt:\n"
+    "    .quad 0x0000000000000000\n"
+    "    .quad 0x00CF9A000000FFFF\n"
+    "    .quad 0x00CF92000000FFFF\n"
+    "smp_tramp_gdtr:\n"
+    "    .word 23\n"
+    "    .long " STR(SMP_TRAMPOLINE) " + (smp_tramp_gdt - smp_trampoline_start)\n"
+    "smp_tramp_stack:\n"
+    "    .long 0\n"
+    "smp_tramp_entry:\n"
+    "    .long 0\n"
+    "smp_trampoline_end:\n"
+);
+
+static percpu_t cpus[SMP_MAX_CPUS];
+static uint8_t cpu_stacks[SMP_MAX_CPUS][SMP_STACK_SIZE] __attribute__((aligned(16)));
+static int8_t apic_to_cpu[256];
+static int cpu_count = 1;
+
+__attribute__((naked)) static void smp_wake_stub(void) {
+    asm volatile(
+        "pusha\n"
+        "cld\n"
+        "call lapic_eoi\n"
+        "popa\n"
+        "iret\n"
+    );
+}
+
+int smp_cpu_count(void) {
+    return cpu_count;
+}
+
+int smp_cpu_index(void) {
+    if (cpu_count == 1)
+        return 0;
+
+    int8_t i = apic_to_cpu[lapic_id()];
+    return (i < 0) ? 0 : i;
+}
+
+percpu_t* smp_cpu(int index) {
+    return &cpus[index];
+}
+
+percpu_t* smp_this_cpu(void) {
+    return &cpus[smp_cpu_index()];
+}
+
+static void lapic_send_ipi(uint8_t apic_id, uint32_t icr) {
+    lapic_write(LAPIC_ICR_HI, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, icr);
+
+    while (lapic_read(LAPIC_ICR_LO) & ICR_PENDING)
+        asm volatile("pause");
+}
+
+void smp_send_wake(int index) {
+    lapic_send_ipi(cpus[index].apic_id, ICR_FIXED | SMP_IPI_WAKE);
+}
+
+static void wait_ticks(unsigned int n) {
+    unsigned int until = g_ticks + n;
+
+    while ((int)(g_ticks - until) < 0)
+        asm volatile("hlt");
+}
+
+// First C code on an AP, still on the stack handed over by the trampoline
+static void smp_ap_main(void) {
+    percpu_t* c = &cpus[apic_to_cpu[lapic_id()]];
+
+    gdt_install_cpu(c->index, c->stack_top);
+    idt_flush((uint32_t)&idt_ptr);
+
+    lapic_write(LAPIC_SVR, 0x100 | APIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_TPR, 0);
+    fpu_init_cpu();
+
+    __atomic_store_n(&c->online, 1, __ATOMIC_RELEASE);
+
+    sched_idle_loop(c->index);
+}
+
+static int smp_boot_ap(int index) {
+    percpu_t* c = &cpus[index];
+
+    *(uint32_t*)(SMP_TRAMPOLINE + (smp_tramp_stack - smp_trampoline_start)) = c->stack_top;
+    *(uint32_t*)(SMP_TRAMPOLINE + (smp_tramp_entry - smp_trampoline_start)) = (uint32_t)smp_ap_main;
+
+    // INIT, wait 10 ms, then SIPI twice as the MP spec asks
+    lapic_send_ipi(c->apic_id, ICR_INIT);
+    wait_ticks(2);
+    for (int i = 0; i < 2 && !c->online; i++) {
+        lapic_send_ipi(c->apic_id, ICR_STARTUP | (SMP_TRAMPOLINE >> 12));
+        wait_ticks(1);
+    }
+
+    // Give it up to ~200 ms to check in
+    for (int t = 0; t < 20 && !__atomic_load_n(&c->online, __ATOMIC_ACQUIRE); t++)
+        wait_ticks(1);
+
+    return c->online ? 0 : -1;
+}
+
+// Needs interrupts enabled (the startup delays count PIT ticks)
+int smp_init(void) {
+    memset(apic_to_cpu, -1, sizeof(apic_to_cpu));
+
+    cpus[0].index = 0;
+    cpus[0].online = 1;
+    cpus[0].stack_top = 0x200000; // kernel_entry's stack
+    cpu_count = 1;
+    sched_init();
+
+    if (!apic_enabled())
+        return 1;
+
+    uint8_t bsp = lapic_id();
+    cpus[0].apic_id = bsp;
+    apic_to_cpu[bsp] = 0;
+
+    // The BSP leaves the bootloader's GDT behind before the trampoline reuses low memory
+    gdt_install_cpu(0, cpus[0].stack_top);
+    idt_set_gate(SMP_IPI_WAKE, (uint32_t)smp_wake_stub, 0x08, 0x8E);
+    memcpy((void*)SMP_TRAMPOLINE, smp_trampoline_start, (size_t)(smp_trampoline_end - smp_trampoline_start));
+
+    const acpi_madt_info_t* m = acpi_madt();
+    int count = 1;
+
+    for (int i = 0; i < m->cpu_count && count < SMP_MAX_CPUS; i++) {
+        uint8_t id = m->cpu_apic_id[i];
+        if (id == bsp)
+            continue;
+
+        percpu_t* c = &cpus[count];
+        c->index = count;
+        c->apic_id = id;
+        c->stack_top = (uint32_t)&cpu_stacks[count][SMP_STACK_SIZE];
+        apic_to_cpu[id] = (int8_t)count;
+
+        cpu_count = count + 1;
+
+        if (smp_boot_ap(count) == 0) {
+            count++;
+        } else {
+            apic_to_cpu[id] = -1;
+            cpu_count = count;
+            console_write("[SMP] CPU did not come up, apic id ");
+            char buf[8];
+            console_write(itoa(id, buf, 10));
+            console_write("\n");
+        }
+    }
+
+    cpu_count = count;
+
+    return count;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+#define SMP_MAX_CPUS 8
+#define SMP_STACK_SIZE 16384
+#define SMP_IPI_WAKE 0xF0 // Wakes an idle CPU out of hlt
+
+typedef struct {
+    int index;
+    uint8_t apic_id;
+    volatile int online;
+    volatile int idle;     // Parked in hlt, needs an IPI to notice new work
+    uint32_t stack_top;
+    volatile uint32_t jobs_run;
+    volatile uint32_t jobs_stolen;
+    volatile int fpu_depth;    // Nested kernel_fpu_begin sections
+    volatile int fpu_app_live; // The app's x87/SSE state is in the registers
+} percpu_t;
+
+int smp_init(void);
+int smp_cpu_count(void);
+int smp_cpu_index(void);
+percpu_t* smp_cpu(int index);
+percpu_t* smp_this_cpu(void);
+void smp_send_wake(int index);
@@ -0,0 +1,64 @@
+#include "softirq.h"
+#include "cpu.h"
+#include "../lib/string.h"
+#include <stdint.h>
+
+// Rounds of newly raised work handled per IRQ exit, the rest waits for the next one
+#define SOFTIRQ_RESTARTS 4
+
+static softirq_fn_t handlers[SOFTIRQ_MAX];
+static softirq_stat_t stats[SOFTIRQ_MAX];
+static volatile uint32_t pending = 0;
+static volatile int running = 0;
+
+void softirq_register(int n, softirq_fn_t fn) {
+    if (n >= 0 && n < SOFTIRQ_MAX)
+        handlers[n] = fn;
+}
+
+void raise_softirq(int n) {
+    __atomic_or_fetch(&pending, 1u << n, __ATOMIC_RELEASE);
+}
+
+// Called by irq_handler after the EOI, with interrupts still off. Runs with
+// them back on; an IRQ landing meanwhile sees 'running' and leaves its work
+// for this loop.
+void softirq_run(void) {
+    if (running || !pending)
+        return;
+    running = 1;
+
+    for (int round = 0; round < SOFTIRQ_RESTARTS; round++) {
+        uint32_t p = __atomic_exchange_n(&pending, 0, __ATOMIC_ACQUIRE);
+        if (!p)
+            break;
+
+        asm volatile("sti" : : : "memory");
+
+        for (int n = 0; n < SOFTIRQ_MAX; n++) {
+            if (!(p & (1u << n)) || !handlers[n])
+                continue;
+
+            uint64_t t0 = rdtsc();
+            handlers[n]();
+            uint64_t dt = rdtsc() - t0;
+
+            stats[n].count++;
+            stats[n].total_cycles += dt;
+            if (dt > stats[n].max_cycles)
+                stats[n].max_cycles = dt;
+        }
+
+        asm volatile("cli" : : : "memory");
+    }
+
+    running = 0;
+}
+
+const softirq_stat_t* softirq_stats(void) {
+    return stats;
+}
+
+void softirq_stats_reset(void) {
+    memset(stats, 0, sizeof(stats));
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+// Deferred halves of interrupt handlers. The IRQ only acks the device and
+// raises one of these; the work runs on the way out, with interrupts enabled.
+enum {
+    SOFTIRQ_CURSOR = 0, // Mouse cursor compositing
+    SOFTIRQ_FLUSH = 1,  // Shadow framebuffer -> LFB
+    SOFTIRQ_MAX = 8,
+};
+
+typedef void (*softirq_fn_t)(void);
+
+typedef struct {
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+} softirq_stat_t;
+
+void softirq_register(int n, softirq_fn_t fn);
+void raise_softirq(int n);
+void softirq_run(void);
+const softirq_stat_t* softirq_stats(void);
+void softirq_stats_reset(void);
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+
+// Ticket lock: FIFO handoff, so no CPU starves under contention
+typedef struct {
+    volatile uint16_t next;
+    volatile uint16_t owner;
+} spinlock_t;
+
+#define SPINLOCK_INIT {0, 0}
+
+static inline void spin_lock(spinlock_t* l) {
+    uint16_t me = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+
+    while (__atomic_load_n(&l->owner, __ATOMIC_ACQUIRE) != me)
+        asm volatile("pause");
+}
+
+static inline void spin_unlock(spinlock_t* l) {
+    __atomic_store_n(&l->owner, (uint16_t)(l->owner + 1), __ATOMIC_RELEASE);
+}
+
+// Interrupt-safe variants, for locks that IRQ handlers also take
+static inline uint32_t spin_lock_irqsave(spinlock_t* l) {
+    uint32_t flags;
+
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    spin_lock(l);
+
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* l, uint32_t flags) {
+    spin_unlock(l);
+    if (flags & 0x200) // IF was set
+        asm volatile("sti" : : : "memory");
+}
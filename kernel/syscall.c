@@ -5,6 +5,12 @@
 #include "console.h"
 #include "mouse.h"
 #include "gfx.h"
+#include "cpu.h"
+#include "prof.h"
+#include "sched.h"
+#include "event.h"
+#include "irq.h"
+#include "softirq.h"
 #include "../lib/string.h"
 #include "../lib/stdlib.h"
 #include <stdint.h>
@@ -12,12 +18,22 @@
 static char last_exec_arg[32];
 extern volatile unsigned int g_ticks;
 
+// Per-syscall counters, slot 0 collects unknown numbers
+static sys_stat_t sys_stats[SYS_STATS_MAX];
+static sys_trace_t sys_trace[SYS_TRACE_ENTRIES];
+static uint32_t sys_trace_count = 0; // Total records written, wraps over the ring
+static uint32_t sys_trace_first = 0; // Oldest record not yet overwritten or read
+static int sys_trace_enabled = 0;
+
 typedef uint32_t (*sysfn_t)(uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx);
 
+static uint32_t syscall_dispatch(uint32_t num, uint32_t ebx, uint32_t ecx, uint32_t edx);
+
 __attribute__((naked)) void syscall_trampoline(void) {
     asm volatile(
         ".intel_syntax noprefix\n"
         "pusha\n"
+        "cld\n"
         "push edx\n"
         "push ecx\n"
         "push ebx\n"
@@ -215,49 +231,44 @@ static uint32_t sys_getsize_impl(uint32_t a,uint32_t b,uint32_t c,uint32_t d){
 }
 
 // User passes an array of {char ch; uint8_t attr} cells in row-major.
+// ebx = aso_cell_t grid, ecx = cells. The console diffs it against the last one.
 static uint32_t sys_blit_impl(uint32_t a,uint32_t ebx,uint32_t ecx,uint32_t d){
     (void)a;(void)d;
-    const uint8_t* p = (const uint8_t*)ebx;
-    uint32_t count = ecx;
     int cols=80, rows=25;
 
     console_get_size(&cols, &rows);
-    uint32_t max = (uint32_t)(cols * rows);
-
-    if (count > max) count = max;
-
-    for (uint32_t i=0; i<count; ++i){
-        int x = (int)(i % (uint32_t)cols);
-        int y = (int)(i / (uint32_t)cols);
-        char ch = (char)p[i*2 + 0];
-        uint8_t attr = p[i*2 + 1];
+    uint32_t count = console_blit((const uint16_t*)ebx, ecx);
 
-        console_put_at_color(x, y, ch, attr);
-    }
     // Park cursor out of the way
     console_setcursor(cols-1, rows-1);
 
     return count;
 }
 
+// ebx = state [x, y, buttons] (optional), ecx = mouse_event_t buffer, edx = entries.
+// Returns how many queued events were copied.
 static uint32_t sys_mouse_get_impl(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
     (void)a;
-    (void)c;
-    (void)d;
     int* buf = (int*)b;  // [0]=x, [1]=y, [2]=buttons
+    mouse_event_t* ev = (mouse_event_t*)c;
 
-    if (!buf)
+    if (!buf && !ev)
         return (uint32_t)-1;
 
-    int x, y;
-    unsigned btn;
+    if (buf) {
+        int x, y;
+        unsigned btn;
 
-    mouse_get(&x, &y, &btn);
-    buf[0] = x;
-    buf[1] = y;
-    buf[2] = (int)btn;
+        mouse_get(&x, &y, &btn);
+        buf[0] = x;
+        buf[1] = y;
+        buf[2] = (int)btn;
+    }
 
-    return 0;
+    if (!ev)
+        return 0;
+
+    return (uint32_t)mouse_read_events(ev, (int)d);
 }
 
 static uint32_t sys_mouse_show_impl(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
@@ -270,12 +281,16 @@ static uint32_t sys_mouse_show_impl(uint32_t a, uint32_t b, uint32_t c, uint32_t
     return 0;
 }
 
+// ebx = optional gfx_info_t to fill, for the pixel format
 static uint32_t sys_gfx_info_impl(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
-    (void)a; (void)b; (void)c; (void)d;
+    (void)a; (void)c; (void)d;
     const gfx_info_t* gi = gfx_info();
 
     if (!gi || gi->bpp != 32 || gi->w == 0 || gi->h == 0) 
         return 0; // 0 means “not available”
+
+    if (b)
+        *(gfx_info_t*)b = *gi;
     
     // Pack (w,h) in 16+16 bits
     uint32_t packed = ((uint32_t)(gi->w & 0xFFFF) << 16) | (uint32_t)(gi->h & 0xFFFF);
@@ -290,6 +305,7 @@ static uint32_t sys_gfx_clear_impl(uint32_t a, uint32_t b, uint32_t c, uint32_t
         return (uint32_t)-1;
 
     gfx_clear(b); // b = 0x00RRGGBB
+    console_damage(0, 0, gi->w, gi->h); // Text cells under it are gone
   
     return 0;
 }
@@ -305,10 +321,33 @@ static uint32_t sys_gfx_putpx_impl(uint32_t a, uint32_t b, uint32_t c, uint32_t
         return (uint32_t)-1;
 
     gfx_putpixel(x, y, rgb);
+    console_damage(x, y, 1, 1);
 
     return 0;
 }
 
+// App pixels landed on x, y, w, h: the cells there need repainting once the
+// app is done, and the text on top of them goes back now
+static void text_on_top(int x, int y, int w, int h) {
+    console_damage(x, y, w, h);
+
+    int row0 = (y < 0 ? 0 : y) / CON_CHAR_H;
+    int row1 = (y + h - 1) / CON_CHAR_H;
+    for (int row = row0; row <= row1; row++)
+        console_overlay_row_fg(row);
+}
+
+// One band of text rows. Each row's pixels are converted and get the cached
+// console text composited while they're still in cache.
+static void blit_band(void* arg, int y0, int y1) {
+    for (int y = y0; y < y1; y += CON_CHAR_H) {
+        int end = (y + CON_CHAR_H < y1) ? y + CON_CHAR_H : y1;
+
+        gfx_blit_rows((const uint32_t*)arg, y, end);
+        console_overlay_row_fg(y / CON_CHAR_H);
+    }
+}
+
 static uint32_t sys_gfx_blit_impl(uint32_t a, uint32_t ebx, uint32_t c, uint32_t d) {
     (void)a; (void)c; (void)d;
 
@@ -320,29 +359,262 @@ static uint32_t sys_gfx_blit_impl(uint32_t a, uint32_t ebx, uint32_t c, uint32_t
     if (!src)
         return (uint32_t)-2;
 
-    int w = gi->w;
-    int h = gi->h;
-    uint8_t* fb = (uint8_t*)(uintptr_t)gi->fb;
-    int pitch = gi->pitch;
-
-    for (int y = 0; y < h; y++) {
-        uint32_t* dst = (uint32_t*)(fb + (size_t)y * pitch);
-        const uint32_t* srow = src + (size_t)y * w;
-
-        for (int x = 0; x < w; x++) {
-            uint32_t rgb = srow[x];
-            uint32_t bgr = ((rgb & 0x000000FF) << 16)
-                         |  (rgb & 0x0000FF00)
-                         | ((rgb & 0x00FF0000) >> 16);
-            dst[x] = bgr;
+    // Bands are whole text rows so no glyph straddles two CPUs
+    console_damage(0, 0, gi->w, gi->h);
+    sched_parallel_for(gi->h, CON_CHAR_H, blit_band, (void*)src);
+
+    return (uint32_t)(gi->w * gi->h);
+}
+
+// Pushes only the listed windows of the app's image, console text stays on top.
+// SYSCALL_GFX_BLIT_NATIVE takes pixels already in the framebuffer's format.
+static uint32_t sys_gfx_blit_rect_impl(uint32_t a, uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    int native = (a == SYSCALL_GFX_BLIT_NATIVE);
+
+    const gfx_info_t* gi = gfx_info();
+    if (!gi || gi->bpp != 32)
+        return (uint32_t)-1;
+
+    const uint32_t* src = (const uint32_t*)ebx;
+    const gfx_blit_rect_t* list = (const gfx_blit_rect_t*)ecx;
+    if (!src || !list)
+        return (uint32_t)-2;
+
+    uint32_t total = 0;
+
+    for (uint32_t i = 0; i < edx; i++) {
+        gfx_rect_t drawn;
+        int n = gfx_blit_rect(src, &list[i], native, &drawn);
+
+        if (n <= 0)
+            continue;
+        total += (uint32_t)n;
+        text_on_top(drawn.x, drawn.y, drawn.w, drawn.h);
+    }
+
+    return total;
+}
+
+// One clipped primitive drawn by the kernel, console text stays on top
+static uint32_t sys_gfx_draw_impl(uint32_t a, uint32_t ebx, uint32_t c, uint32_t d) {
+    (void)a; (void)c; (void)d;
+
+    const gfx_info_t* gi = gfx_info();
+    if (!gi || gi->bpp != 32)
+        return (uint32_t)-1;
+
+    const gfx_draw_t* op = (const gfx_draw_t*)ebx;
+    if (!op)
+        return (uint32_t)-2;
+
+    gfx_rect_t drawn;
+
+    if (gfx_draw(op, &drawn) < 0)
+        return (uint32_t)-3;
+
+    if (drawn.w > 0)
+        text_on_top(drawn.x, drawn.y, drawn.w, drawn.h);
+
+    return 0;
+}
+
+// A whole frame of draw commands in one trap, see gfx_exec
+static uint32_t sys_gfx_cmds_impl(uint32_t a, uint32_t ebx, uint32_t ecx, uint32_t d) {
+    (void)a; (void)d;
+
+    const gfx_info_t* gi = gfx_info();
+    if (!gi || gi->bpp != 32)
+        return (uint32_t)-1;
+
+    if (!ebx)
+        return (uint32_t)-2;
+
+    int b[4];
+    int n = gfx_exec((const uint8_t*)ebx, ecx, b);
+
+    if (b[0] < b[2])
+        text_on_top(b[0], b[1], b[2] - b[0], b[3] - b[1]);
+
+    return (n < 0) ? (uint32_t)-3 : (uint32_t)n;
+}
+
+// Ops that never return or would recurse can't be part of a batch
+static int sys_submit_allowed(uint32_t op) {
+    return op != SYSCALL_EXIT && op != SYSCALL_EXEC && op != SYSCALL_SUBMIT;
+}
+
+// Drains the app's submission queue in order, posting results to its completion queue
+static uint32_t sys_submit_impl(uint32_t a, uint32_t ebx, uint32_t c, uint32_t d) {
+    (void)a; (void)c; (void)d;
+
+    sys_ring_t* ring = (sys_ring_t*)ebx;
+    if (!ring)
+        return (uint32_t)-1;
+
+    uint32_t head = ring->sq_head;
+    uint32_t tail = ring->sq_tail;
+
+    if (tail - head > SYS_RING_ENTRIES)
+        return (uint32_t)-2; // Indexes are garbage
+
+    uint32_t done = 0;
+    uint32_t posted = 0;
+
+    while (head != tail) {
+        // Stop while the app still has completions to reap, the rest stays queued
+        if (ring->cq_tail - ring->cq_head >= SYS_RING_ENTRIES)
+            break;
+
+        const sys_sqe_t* sqe = &ring->sq[head & SYS_RING_MASK];
+        uint32_t res = sys_submit_allowed(sqe->op)
+                     ? syscall_dispatch(sqe->op, sqe->ebx, sqe->ecx, sqe->edx)
+                     : (uint32_t)-1;
+
+        if (!(sqe->flags & SQE_F_NOCQE) || (int32_t)res < 0) {
+            sys_cqe_t* cqe = &ring->cq[ring->cq_tail & SYS_RING_MASK];
+
+            cqe->user_data = sqe->user_data;
+            cqe->res = res;
+            ring->cq_tail++;
+            posted++;
         }
 
-        // After finishing a full 16-px text row, overlay its glyphs immediately
-        if ((y % CON_CHAR_H) == (CON_CHAR_H - 1))
-            console_overlay_row_fg(y / CON_CHAR_H);
+        head++;
+        done++;
     }
 
-    return (uint32_t)(w * h);
+    ring->sq_head = head;
+
+    if (posted)
+        event_post(EV_IO, SYSCALL_SUBMIT, 0, 0, posted);
+
+    return done;
+}
+
+// ebx = EVM_* mask, ecx = timeout in ticks (0 = poll, EV_WAIT_FOREVER), edx = event_t*
+static uint32_t sys_wait_event_impl(uint32_t a, uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)a;
+
+    event_t* out = (event_t*)edx;
+    if (!out)
+        return (uint32_t)-1;
+
+    return (uint32_t)event_wait(ebx, ecx, out);
+}
+
+// ebx = kbd_event_t buffer, ecx = entries. Returns how many were copied.
+static uint32_t sys_kbd_read_impl(uint32_t a, uint32_t ebx, uint32_t ecx, uint32_t d) {
+    (void)a; (void)d;
+
+    kbd_event_t* out = (kbd_event_t*)ebx;
+    if (!out)
+        return (uint32_t)-1;
+
+    return (uint32_t)kbd_read_events(out, (int)ecx);
+}
+
+// Apps share our address space, so the live key bitmap is handed out directly
+static uint32_t sys_kbd_state_impl(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    (void)a; (void)b; (void)c; (void)d;
+
+    return (uint32_t)kbd_shared_state();
+}
+
+static uint32_t sys_stats_impl(uint32_t a, uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)a;
+
+    switch (ebx) {
+    case SYS_STATS_GET: {
+        sys_stat_t* out = (sys_stat_t*)ecx;
+        uint32_t n = (edx < SYS_STATS_MAX) ? edx : SYS_STATS_MAX;
+
+        if (!out)
+            return (uint32_t)-1;
+        memcpy(out, sys_stats, n * sizeof(sys_stat_t));
+
+        return n;
+    }
+    case SYS_STATS_RESET:
+        memset(sys_stats, 0, sizeof(sys_stats));
+        sys_trace_count = sys_trace_first = 0;
+        irq_stats_reset();
+        softirq_stats_reset();
+
+        return 0;
+    case SYS_STATS_TRACE_ON:
+        sys_trace_count = sys_trace_first = 0;
+        sys_trace_enabled = 1;
+
+        return 0;
+    case SYS_STATS_TRACE_OFF:
+        sys_trace_enabled = 0;
+
+        return 0;
+    case SYS_STATS_TRACE_READ: {
+        sys_trace_t* out = (sys_trace_t*)ecx;
+        if (!out)
+            return (uint32_t)-1;
+
+        // The newest n go out and their slots are free again; older ones
+        // that didn't fit stay for the next read
+        uint32_t avail = sys_trace_count - sys_trace_first;
+        uint32_t n = (edx < avail) ? edx : avail;
+        uint32_t first = sys_trace_count - n;
+
+        for (uint32_t i = 0; i < n; i++)
+            out[i] = sys_trace[(first + i) % SYS_TRACE_ENTRIES];
+        sys_trace_count = first;
+
+        return n;
+    }
+    case SYS_STATS_IRQ: {
+        sys_stat_t* out = (sys_stat_t*)ecx;
+        if (!out)
+            return (uint32_t)-1;
+
+        const irq_stat_t* is = irq_stats();
+        const softirq_stat_t* ss = softirq_stats();
+        uint32_t n = 0;
+
+        for (int i = 0; i < 16 && n < edx; i++, n++) {
+            out[n].calls = is[i].count;
+            out[n].reserved = 0;
+            out[n].total_cycles = is[i].total_cycles;
+            out[n].max_cycles = is[i].max_cycles;
+        }
+        for (int i = 0; i < SOFTIRQ_MAX && n < edx; i++, n++) {
+            out[n].calls = ss[i].count;
+            out[n].reserved = 0;
+            out[n].total_cycles = ss[i].total_cycles;
+            out[n].max_cycles = ss[i].max_cycles;
+        }
+
+        return n;
+    }
+    default:
+        return (uint32_t)-1;
+    }
+}
+
+static uint32_t sys_prof_impl(uint32_t a, uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)a;
+
+    switch (ebx) {
+    case SYS_PROF_START:
+        prof_start(ecx);
+        return 0;
+    case SYS_PROF_STOP:
+        return prof_stop();
+    case SYS_PROF_RESET:
+        prof_reset();
+        return 0;
+    case SYS_PROF_DUMP: {
+        int n = prof_dump((prof_sample_t*)ecx, (int)edx);
+        return (n < 0) ? (uint32_t)-1 : (uint32_t)n;
+    }
+    default:
+        return (uint32_t)-1;
+    }
 }
 
 // Dispatch table
@@ -380,13 +652,59 @@ static const sysfn_t sys_table[] = {
     [SYSCALL_GFX_CLEAR]   = sys_gfx_clear_impl,
     [SYSCALL_GFX_PUTPX]   = sys_gfx_putpx_impl,
     [SYSCALL_GFX_BLIT]    = sys_gfx_blit_impl,
+    [SYSCALL_SUBMIT]      = sys_submit_impl,
+    [SYSCALL_STATS]       = sys_stats_impl,
+    [SYSCALL_PROF]        = sys_prof_impl,
+    [SYSCALL_WAIT_EVENT]  = sys_wait_event_impl,
+    [SYSCALL_KBD_READ]    = sys_kbd_read_impl,
+    [SYSCALL_KBD_STATE]   = sys_kbd_state_impl,
+    [SYSCALL_GFX_BLIT_RECT] = sys_gfx_blit_rect_impl,
+    [SYSCALL_GFX_BLIT_NATIVE] = sys_gfx_blit_rect_impl,
+    [SYSCALL_GFX_DRAW]    = sys_gfx_draw_impl,
+    [SYSCALL_GFX_CMDS]    = sys_gfx_cmds_impl,
 };
 
-uint32_t syscall_handler(uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx) {
-    uint32_t num = eax;
+static uint32_t syscall_dispatch(uint32_t num, uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    sysfn_t fn = sys_unknown_impl;
 
     if (num < (sizeof(sys_table)/sizeof(sys_table[0])) && sys_table[num])
-        return sys_table[num](eax, ebx, ecx, edx);
+        fn = sys_table[num];
+
+    sys_stat_t* st = &sys_stats[(fn != sys_unknown_impl && num < SYS_STATS_MAX) ? num : 0];
+    st->calls++; // Counted up front, EXIT and EXEC never come back here
+
+    uint64_t t0 = rdtsc();
+    uint32_t res = fn(num, ebx, ecx, edx);
+    uint64_t dt = rdtsc() - t0;
+
+    st->total_cycles += dt;
+    if (dt > st->max_cycles)
+        st->max_cycles = dt;
+
+    if (sys_trace_enabled) {
+        sys_trace_t* tr = &sys_trace[sys_trace_count % SYS_TRACE_ENTRIES];
+
+        tr->tsc = t0;
+        tr->num = num;
+        tr->ebx = ebx;
+        tr->ecx = ecx;
+        tr->edx = edx;
+        tr->res = res;
+        tr->cycles = (dt > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)dt;
+        sys_trace_count++;
+        // Only the last SYS_TRACE_ENTRIES records survive
+        if (sys_trace_count - sys_trace_first > SYS_TRACE_ENTRIES)
+            sys_trace_first = sys_trace_count - SYS_TRACE_ENTRIES;
+    }
+
+    return res;
+}
+
+uint32_t syscall_handler(uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    uint32_t res = syscall_dispatch(eax, ebx, ecx, edx);
+
+    // Whatever the call drew reaches the screen before the app continues
+    gfx_flush();
 
-    return sys_unknown_impl(eax, ebx, ecx, edx);
+    return res;
 }
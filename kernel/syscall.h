@@ -25,6 +25,78 @@ enum {
     SYSCALL_GFX_CLEAR = 21,
     SYSCALL_GFX_PUTPX = 22,
     SYSCALL_GFX_BLIT = 23,
+    SYSCALL_SUBMIT = 24,
+    SYSCALL_STATS = 25,
+    SYSCALL_PROF = 26,
+    SYSCALL_WAIT_EVENT = 27,
+    SYSCALL_KBD_READ = 28,
+    SYSCALL_KBD_STATE = 29,
+    SYSCALL_GFX_BLIT_RECT = 30, // ebx = RGB source, ecx = gfx_blit_rect_t list, edx = count
+    SYSCALL_GFX_BLIT_NATIVE = 31, // Same, source already in the framebuffer's format
+    SYSCALL_GFX_DRAW = 32, // ebx = gfx_draw_t
+    SYSCALL_GFX_CMDS = 33, // ebx = gfx_cmd_t buffer, ecx = bytes
 };
 
+// SYSCALL_PROF sub-commands (ebx)
+enum {
+    SYS_PROF_START = 0, // ecx = PROF_F_* flags
+    SYS_PROF_STOP = 1,  // Returns the number of samples taken
+    SYS_PROF_RESET = 2,
+    SYS_PROF_DUMP = 3,  // ecx = prof_sample_t buffer, edx = entries
+};
+
+// SYSCALL_STATS sub-commands (ebx), buffers go in ecx and their entry count in edx
+enum {
+    SYS_STATS_GET = 0,     // Copies sys_stat_t per syscall number
+    SYS_STATS_RESET = 1,
+    SYS_STATS_TRACE_ON = 2,
+    SYS_STATS_TRACE_OFF = 3,
+    SYS_STATS_TRACE_READ = 4, // Copies and consumes the newest sys_trace_t records, oldest first
+    SYS_STATS_IRQ = 5,     // Copies sys_stat_t for IRQ 0-15, then one per softirq
+};
+
+#define SYS_STATS_MAX 64
+#define SYS_TRACE_ENTRIES 256
+
+typedef struct {
+    uint32_t calls;
+    uint32_t reserved;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+} sys_stat_t;
+
+typedef struct {
+    uint64_t tsc; // Entry timestamp
+    uint32_t num;
+    uint32_t ebx, ecx, edx;
+    uint32_t res;
+    uint32_t cycles;
+} sys_trace_t;
+
+// Submission ring shared with apps (SYSCALL_SUBMIT). Indexes are free-running,
+// the app advances sq_tail/cq_head and the kernel advances sq_head/cq_tail.
+#define SYS_RING_ENTRIES 256
+#define SYS_RING_MASK (SYS_RING_ENTRIES - 1)
+
+#define SQE_F_NOCQE 0x0001 // Only post a completion if the op fails
+
+typedef struct {
+    uint16_t op; // SYSCALL_* number
+    uint16_t flags;
+    uint32_t ebx, ecx, edx;
+    uint32_t user_data;
+} sys_sqe_t;
+
+typedef struct {
+    uint32_t user_data;
+    uint32_t res;
+} sys_cqe_t;
+
+typedef struct {
+    volatile uint32_t sq_head, sq_tail;
+    volatile uint32_t cq_head, cq_tail;
+    sys_sqe_t sq[SYS_RING_ENTRIES];
+    sys_cqe_t cq[SYS_RING_ENTRIES];
+} sys_ring_t;
+
 void syscall_init(void);
@@ -1,4 +1,5 @@
 #include "vga.h"
+#include "../lib/string.h"
 
 #define VGA_MEMORY ((uint16_t*)0xB8000)
 #define VGA_WIDTH 80
@@ -19,6 +20,14 @@ void vga_clear(void) {
     row = col = 0;
 }
 
+// Every line moves up one, the last one is cleared
+void vga_scroll_up(void) {
+    memmove(vga, vga + VGA_WIDTH, (size_t)VGA_WIDTH * (VGA_HEIGHT - 1) * 2);
+
+    for (int x = 0; x < VGA_WIDTH; x++)
+        vga[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = vga_entry(' ', color);
+}
+
 void vga_putchar(char c) {
     if (c == '\n') {
         row++;
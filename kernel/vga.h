@@ -7,3 +7,4 @@ void vga_putchar(char c);
 void vga_putchar_at(int x, int y, char c, uint8_t color);
 void vga_write(const char* s);
 void vga_set_pos(int x, int y);
+void vga_scroll_up(void);
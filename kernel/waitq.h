@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+
+extern volatile unsigned int g_ticks;
+
+// Sleepers remember seq and hlt until it moves. Producers run in IRQ context
+// on the BSP, so the hlt is always woken by the same interrupt that bumped seq.
+typedef struct {
+    volatile uint32_t seq;
+} waitq_t;
+
+static inline uint32_t waitq_seq(const waitq_t* wq) {
+    return wq->seq;
+}
+
+static inline void waitq_wake(waitq_t* wq) {
+    __atomic_add_fetch(&wq->seq, 1, __ATOMIC_RELEASE);
+}
+
+// Sleeps until seq differs from 'seen' or g_ticks reaches 'deadline'.
+// forever != 0 ignores the deadline. Returns 0 when woken, -1 on timeout.
+static inline int waitq_sleep(waitq_t* wq, uint32_t seen, uint32_t deadline, int forever) {
+    for (;;) {
+        // cli; check; sti; hlt closes the gap where the wakeup lands before the hlt
+        asm volatile("cli" : : : "memory");
+
+        if (wq->seq != seen) {
+            asm volatile("sti" : : : "memory");
+            return 0;
+        }
+        if (!forever && (int32_t)(g_ticks - deadline) >= 0) {
+            asm volatile("sti" : : : "memory");
+            return -1;
+        }
+
+        asm volatile("sti; hlt" : : : "memory");
+    }
+}
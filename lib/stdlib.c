@@ -36,6 +36,45 @@ char *itoa(int value, char *str, int base) {
     return str;
 }
 
+char *ulltoa(unsigned long long value, char *str, int base) {
+    char tmp[65];
+    int n = 0;
+
+    if (base < 2 || base > 36) {
+        *str = '\0';
+        return str;
+    }
+
+    // Long division on 16-bit limbs, a 64-bit '/' would need libgcc
+    unsigned int limb[4] = {
+        (unsigned int)(value >> 48) & 0xFFFF,
+        (unsigned int)(value >> 32) & 0xFFFF,
+        (unsigned int)(value >> 16) & 0xFFFF,
+        (unsigned int)value & 0xFFFF,
+    };
+    unsigned int left;
+
+    do {
+        unsigned int rem = 0;
+
+        left = 0;
+        for (int i = 0; i < 4; i++) {
+            unsigned int cur = (rem << 16) | limb[i];
+
+            limb[i] = cur / (unsigned int)base;
+            rem = cur % (unsigned int)base;
+            left |= limb[i];
+        }
+        tmp[n++] = "0123456789abcdefghijklmnopqrstuvwxyz"[rem];
+    } while (left);
+
+    for (int i = 0; i < n; i++)
+        str[i] = tmp[n - 1 - i];
+    str[n] = '\0';
+
+    return str;
+}
+
 int atoi(const char *str) {
     int res = 0;
     int sign = 1;
@@ -2,4 +2,5 @@
 
 int abs(int x);
 char *itoa(int value, char *str, int base);
+char *ulltoa(unsigned long long value, char *str, int base);
 int atoi(const char *str);
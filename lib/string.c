@@ -1,14 +1,43 @@
 #include "string.h"
 
 void *memcpy(void *dest, const void *src, size_t n) {
+	return memmove(dest, src, n);
+}
+
+// Dwords then the tail bytes, or the same backwards from the end when dest
+// overlaps the upper part of src
+void *memmove(void *dest, const void *src, size_t n) {
 	unsigned char *d = dest;
 	const unsigned char *s = src;
 
-
-	for (size_t i = 0; i < n; i++) {
-		d[i] = s[i];
+	if (d <= s || d >= s + n) {
+		size_t dwords = n / 4;
+
+		asm volatile("cld\n"
+		             "rep movsl\n"
+		             "mov %3, %%ecx\n"
+		             "rep movsb"
+		             : "+D"(d), "+S"(s), "+c"(dwords)
+		             : "r"(n & 3)
+		             : "memory");
+	} else {
+		size_t tail = n & 3;
+
+		// Top bytes first, then dwords downwards from the one below them
+		d += n - 1;
+		s += n - 1;
+		asm volatile("std\n"
+		             "rep movsb\n"
+		             "sub $3, %%edi\n"
+		             "sub $3, %%esi\n"
+		             "mov %3, %%ecx\n"
+		             "rep movsl\n"
+		             "cld"
+		             : "+D"(d), "+S"(s), "+c"(tail)
+		             : "r"(n / 4)
+		             : "memory");
 	}
-	
+
 	return dest;
 }
 
@@ -22,6 +51,18 @@ void *memset(void *s, int c, size_t n) {
 	return s;
 }
 
+int memcmp(const void *s1, const void *s2, size_t n) {
+	const unsigned char *a = s1;
+	const unsigned char *b = s2;
+
+	for (size_t i = 0; i < n; i++) {
+		if (a[i] != b[i])
+			return a[i] - b[i];
+	}
+
+	return 0;
+}
+
 size_t strlen(const char *str) {
 	size_t len = 0;
 
@@ -2,10 +2,11 @@ import os, struct
 
 ASOFS_MAGIC = 0x41534F46 # "ASOF" in ASCII
 SECTOR_SIZE = 512
-SUPERBLOCK_LBA = 50
-APP_START_LBA = 60 # First sector after superblock 
+SUPERBLOCK_LBA = 1024 # Kernel image sits at LBA 5 up to here
+APP_START_LBA = 1034 # First sector after superblock 
 APP_DIR = "app"
 DISK_IMG = "disk.img"
+SYMTAB = "asos.sym" # Profiler symbols, shipped next to the apps when built
 
 
 def align_up(x, to):
@@ -16,13 +17,15 @@ def main():
     entries = []
     current_lba = APP_START_LBA
 
-    with open(DISK_IMG, "r+b") as disk:
-        # Look for all .bin apps
-        for fname in sorted(os.listdir(APP_DIR)):
-            if not fname.endswith(".bin"):
-                continue
+    # Look for all .bin apps
+    files = [(fname, os.path.join(APP_DIR, fname))
+             for fname in sorted(os.listdir(APP_DIR)) if fname.endswith(".bin")]
+
+    if os.path.exists(SYMTAB):
+        files.append((SYMTAB, SYMTAB))
 
-            path = os.path.join(APP_DIR, fname)
+    with open(DISK_IMG, "r+b") as disk:
+        for fname, path in files:
             with open(path, "rb") as f:
                 data = f.read()
 
@@ -0,0 +1,68 @@
+import os, subprocess, sys
+
+# Usage: make_symtab.py <out> <kernel.elf> [app/*.elf ...]
+# Writes one "# <image>" header per ELF followed by "<hex addr> <symbol>" lines
+# sorted by address, for the profiler to resolve samples on the target.
+
+NM = os.environ.get("NM", "nm")
+
+# The terminal reads the table into a SYM_FILE_MAX (64 KiB) buffer and the
+# loader writes whole sectors, so the file has to leave room for its NUL
+MAX_BYTES = 65536 - 1
+
+
+def text_symbols(elf):
+    out = subprocess.run([NM, "-n", elf], check=True, capture_output=True, text=True).stdout
+    syms = []
+
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) != 3:
+            continue
+
+        addr, kind, name = parts
+        if kind not in ("T", "t"):
+            continue
+
+        syms.append((int(addr, 16), name))
+
+    return syms
+
+
+def image_name(elf):
+    base = elf.replace("\\", "/").split("/")[-1]
+    if base == "kernel.elf":
+        return "kernel"
+
+    return base[:-len(".elf")] + ".bin"
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("usage: make_symtab.py <out> <kernel.elf> [apps.elf...]")
+        sys.exit(1)
+
+    out_path = sys.argv[1]
+    lines = []
+
+    for elf in sys.argv[2:]:
+        syms = text_symbols(elf)
+        lines.append(f"# {image_name(elf)}")
+        lines.extend(f"{addr:08x} {name}" for addr, name in syms)
+        print(f"[+] {elf}: {len(syms)} symbols")
+
+    text = "\n".join(lines) + "\n"
+    if len(text) > MAX_BYTES:
+        cut = text.rfind("\n", 0, MAX_BYTES) + 1
+        dropped = text.count("\n", cut)
+        text = text[:cut]
+        print(f"[!] Symbol table over {MAX_BYTES} bytes, dropped the last {dropped} lines")
+
+    with open(out_path, "w") as f:
+        f.write(text)
+
+    print(f"[D] Symbol table written to {out_path}")
+
+
+if __name__ == "__main__":
+    main()
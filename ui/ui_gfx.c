@@ -25,8 +25,7 @@ void ui_gfx_put_char(int cx, int cy, char c, uint32_t fg, uint32_t bg) {
 }
 
 void ui_gfx_put_text(int x, int y, const char* s, uint32_t fg, uint32_t bg) {
-    for (int i = 0; s[i]; i++)
-        ui_gfx_put_char(x + i, y, s[i], fg, bg);
+    gfx_draw_text(x * CHAR_W, y * CHAR_H, s, fg, bg);
 }
 
 void ui_gfx_printf(int x, int y, const char* fmt, ...) {